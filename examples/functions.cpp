@@ -86,6 +86,16 @@ void test_exception()
   throw std::runtime_error("This is an exception");
 }
 
+// Exception type that does not derive from std::exception, translated using jlcxx::register_exception
+struct CustomError
+{
+};
+
+void test_custom_exception()
+{
+  throw CustomError();
+}
+
 std::string test_type_name(const std::string& name)
 {
   return jlcxx::julia_type_name(jlcxx::julia_type(name));
@@ -103,6 +113,15 @@ JLCXX_MODULE init_half_module(jlcxx::Module& mod)
   // Register a lambda
   mod.method("half_lambda", [](const double a) {return a*0.5;});
 
+  // Scalar function plus an array kernel half_vectorized!(in, out)
+  mod.method_vectorized("half_vectorized", [](const double a) {return a*0.5;});
+
+  // Lets the Julia GC run on other threads during the call
+  mod.method("half_gc_safe", [](const double a) {return a*0.5;}, jlcxx::gc_safe);
+
+  // Runs on the C++ thread pool, use fetch(half_async(x)) to get the result
+  mod.method("half_async", [](const double a) {return a*0.5;}, jlcxx::async);
+
   // Strict number typing
   mod.method("strict_half", [](const jlcxx::StrictlyTypedNumber<double> a) {return a.value*0.5;});
 
@@ -215,6 +234,11 @@ JLCXX_MODULE init_test_module(jlcxx::Module& mod)
   mod.method("test_float_array", test_float_array);
   mod.method("test_double_array", test_double_array);
   mod.method("test_exception", test_exception, jlcxx::calling_policy::std_function);
+  jl_value_t* custom_error_msg = jl_cstr_to_string("This is a custom exception");
+  JL_GC_PUSH1(&custom_error_msg);
+  jlcxx::register_exception<CustomError>(jl_new_struct(jl_argumenterror_type, custom_error_msg));
+  JL_GC_POP();
+  mod.method("test_custom_exception", test_custom_exception, jlcxx::calling_policy::std_function);
   mod.method("test_array_len", test_array_len);
   mod.method("test_array_set", test_array_set);
   mod.method("test_array_get", test_array_get);
@@ -151,6 +151,23 @@ struct Foo3FreeMethod
   jlcxx::Module& m_module;
 };
 
+template<typename T1, typename T2>
+struct DeferredPair
+{
+  T1 first;
+  T2 second;
+};
+
+struct WrapDeferredPair
+{
+  template<typename TypeWrapperT>
+  void operator()(TypeWrapperT&& wrapped)
+  {
+    typedef typename TypeWrapperT::type WrappedT;
+    wrapped.method("pair_first", [] (const WrappedT& p) { return p.first; });
+  }
+};
+
 template<typename T1, bool B = false>
 struct Foo2
 {
@@ -236,6 +253,7 @@ namespace jlcxx
   template<typename T1> struct IsMirroredType<ConcreteTemplate<T1>> : std::false_type { };
   template<typename T1, typename T2, typename T3> struct IsMirroredType<Foo3<T1,T2,T3>> : std::false_type { };
   template<typename T1, bool B> struct IsMirroredType<Foo2<T1,B>> : std::false_type { };
+  template<typename T1, typename T2> struct IsMirroredType<DeferredPair<T1,T2>> : std::false_type { };
   template<typename T1> struct IsMirroredType<CppVector<T1>> : std::false_type { };
   template<typename T1, typename T2> struct IsMirroredType<CppVector2<T1,T2>> : std::false_type { };
 
@@ -270,6 +288,11 @@ JLCXX_MODULE define_julia_module(jlcxx::Module& types)
   typedef jlcxx::combine_types<jlcxx::ApplyType<Foo3>, ParameterList<int32_t, double>, ParameterList<P1,P2,bool>, ParameterList<float>> foo3_types;
   jlcxx::for_each_type<foo3_types>(Foo3FreeMethod(types));
 
+  // Only DeferredPair{Int32,Float64} is created here, by the return type of make_deferred_pair
+  types.add_type<Parametric<TypeVar<1>, TypeVar<2>>>("DeferredPair")
+    .apply_combination_deferred<DeferredPair, ParameterList<int32_t, double>, ParameterList<int32_t, double>>(WrapDeferredPair());
+  types.method("make_deferred_pair", [] (int32_t a, double b) { return DeferredPair<int32_t, double>{a, b}; });
+
   types.add_type<Parametric<TypeVar<1>>>("Foo2")
     .apply_combination<ApplyFoo2, ParameterList<int32_t, double>>(WrapFoo2());
 
@@ -239,6 +239,7 @@ JLCXX_MODULE define_julia_module(jlcxx::Module& types)
     .constructor([] (const std::string& a, const std::string& b) { return new World(a + " " + b); })
     .method("set", &World::set)
     .method("greet_cref", &World::greet)
+    .method<&World::greet>("greet_static")
     .method("greet_lambda", [] (const World& w) { return w.greet(); } )
     .method("greet_byvalue", [] (World w) { return w.greet(); } );
 
@@ -138,6 +138,17 @@ public:
     JL_GC_POP();
   }
 
+  /// Set element i. Faster than push_back when the final size is known on construction
+  template<typename VT>
+  void set(const size_t i, VT&& val)
+  {
+    assert(i < jl_array_len(m_array));
+    JL_GC_PUSH1(&m_array);
+    jl_value_t* jval = box<ValueT>(val);
+    jl_array_ptr_set(m_array, i, jval);
+    JL_GC_POP();
+  }
+
   /// Access to the wrapped array
   jl_array_t* wrapped()
   {
@@ -297,7 +308,7 @@ struct PackedArrayType<T*, WrappedPtrTrait>
 {
   static jl_datatype_t* type()
   {
-    return apply_type(jlcxx::julia_type("Ptr"), julia_base_type<T>());
+    return apply_type(core_types().ptr, julia_base_type<T>());
   }
 };
 
@@ -353,6 +364,9 @@ auto make_julia_array(ValueT* c_ptr, const SizesT... sizes) -> ArrayRef<ValueT,
   return ArrayRef<ValueT, sizeof...(SizesT)>(false, c_ptr, sizes...);
 }
 
+template<typename T, int Dim> struct IsJuliaObjectType<ArrayRef<T,Dim>> : std::true_type {};
+template<typename T> struct IsJuliaObjectType<Array<T>> : std::true_type {};
+
 template<typename T, typename SubTraitT>
 struct static_type_mapping<Array<T>, CxxWrappedTrait<SubTraitT>>
 {
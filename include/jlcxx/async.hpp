@@ -0,0 +1,85 @@
+#ifndef JLCXX_ASYNC_HPP
+#define JLCXX_ASYNC_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "jlcxx_config.hpp"
+#include "julia_headers.hpp"
+
+// This header provides the worker pool and result handle used by functions registered with the jlcxx::async attribute
+
+namespace jlcxx
+{
+
+/// Fixed-size pool of C++ worker threads, processing tasks in submission order
+class JLCXX_API ThreadPool
+{
+public:
+  ThreadPool(const std::size_t nb_threads);
+  /// Finishes the queued tasks and joins the workers
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(std::function<void()> task);
+
+  std::size_t size() const { return m_workers.size(); }
+
+private:
+  void run_worker();
+
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_task_available;
+  bool m_stopping = false;
+};
+
+/// The pool used for async calls, with one thread per hardware thread. It is never destroyed, so unfinished calls don't block process exit.
+JLCXX_API ThreadPool& async_thread_pool();
+
+/// Handle to a call running on the async thread pool, exposed to Julia as CxxWrap.StdLib.AsyncCall.
+/// Julia tasks can wait or fetch on it: completion is signalled through a Base.AsyncCondition, so waiting doesn't block the Julia thread.
+class JLCXX_API AsyncCall
+{
+public:
+  /// Produces the Julia value for the result. Called on the Julia thread, since it may allocate.
+  using result_boxer_t = std::function<jl_value_t*()>;
+  /// Runs on a worker thread and returns the boxer for its result (empty for void functions)
+  using task_t = std::function<result_boxer_t()>;
+
+  /// Must be called from Julia, since this allocates the condition
+  AsyncCall();
+  /// Doesn't wait for the task: the worker keeps the shared state and the condition alive until it is done
+  ~AsyncCall();
+
+  AsyncCall(const AsyncCall&) = delete;
+  AsyncCall& operator=(const AsyncCall&) = delete;
+
+  /// Submit the task to the async thread pool
+  void start(task_t task);
+
+  bool done() const;
+
+  /// Wait for completion, yielding to other Julia tasks in the meantime. A Julia exception thrown while waiting (e.g. an InterruptException)
+  /// is passed on as JuliaError.
+  void wait();
+
+  /// Wait and return the result, or rethrow the exception thrown by the task
+  jl_value_t* fetch();
+
+private:
+  struct State;
+  std::shared_ptr<State> m_state;
+};
+
+}
+
+#endif
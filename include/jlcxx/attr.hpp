@@ -61,6 +61,19 @@ enum class finalize_policy : bool
 /// default value for the finalize_policy argument for Module::constructor
 constexpr auto default_finalize_policy = finalize_policy::yes;
 
+/// Type of the gc_safe attribute
+struct gc_safe_t {};
+/// Pass jlcxx::gc_safe to Module::method to run a long computation in a GC-safe region, so the garbage collector can run on other threads
+/// in the meantime. The function can't access any Julia objects, so argument and return types are restricted to C++ types.
+constexpr gc_safe_t gc_safe{};
+
+/// Type of the async attribute
+struct async_t {};
+/// Pass jlcxx::async to Module::method to run the function on the C++ thread pool from async.hpp. The call returns an AsyncCall handle immediately,
+/// which Julia can wait on or fetch the result from. Arguments are copied, including const references, so non-const reference arguments (and non-const
+/// methods) are rejected at compile time. Objects pointed to by pointer arguments must stay valid until the call is done.
+constexpr async_t async{};
+
 
 namespace detail
 {
@@ -132,6 +145,24 @@ namespace detail
     }
   };
 
+  /// gc_safe is handled at compile time by Module::method
+  template<>
+  struct process_attribute<gc_safe_t>
+  {
+    static inline void init(gc_safe_t, ExtraFunctionData&)
+    {
+    }
+  };
+
+  /// async is handled at compile time by Module::method
+  template<>
+  struct process_attribute<async_t>
+  {
+    static inline void init(async_t, ExtraFunctionData&)
+    {
+    }
+  };
+
   template<typename T>
   void parse_attributes_helper(ExtraFunctionData& f, T argi)
   {
@@ -151,6 +182,8 @@ namespace detail
     constexpr bool contains_finalize_policy = (std::is_same_v<finalize_policy, Extra> || ... );
     static_assert( (!contains_finalize_policy) || AllowFinalizePolicy, "finalize_policy can only be set for constructors!");
 
+    static_assert(!(std::is_same_v<gc_safe_t, Extra> || ...) || !(std::is_same_v<async_t, Extra> || ...), "gc_safe and async can't be combined, async functions don't run on a Julia thread");
+
     ExtraFunctionData result;
 
     (parse_attributes_helper(result, std::move(extra)), ...);
@@ -168,6 +201,14 @@ namespace detail
   static_assert(count_attributes<float, int, float, int, double>() == 1);
   static_assert(count_attributes<int, int, float, int, double, int, int>() == 4);
 
+  /// true if the gc_safe attribute was passed
+  template<typename... Extra>
+  constexpr bool has_gc_safe = count_attributes<gc_safe_t, Extra...>() != 0;
+
+  /// true if the async attribute was passed
+  template<typename... Extra>
+  constexpr bool has_async = count_attributes<async_t, Extra...>() != 0;
+
   /// check number of arguments matches annotated arguments if annotations for keyword arguments are present
   template<typename...  Extra>
   constexpr bool check_extra_argument_count(int n_arg)
@@ -109,7 +109,7 @@ struct julia_type_factory<ConstArray<T,N>, ConstArrayTrait>
   static jl_datatype_t* julia_type()
   {
     create_if_not_exists<T>();
-    jl_value_t* pdt = ::jlcxx::julia_type("ConstArray");
+    jl_value_t* pdt = ::jlcxx::core_types().const_array;
     jl_value_t* val = box<index_t>(N);
     jl_value_t* result;
     JL_GC_PUSH1(&val);
@@ -110,6 +110,9 @@ struct SafeCFunction
   jl_array_t* argtypes;
 };
 
+// Calling the function pointer runs Julia code
+template<> struct IsJuliaObjectType<SafeCFunction> : std::true_type {};
+
 // Direct conversion
 template<> struct static_type_mapping<SafeCFunction>
 {
@@ -118,7 +121,7 @@ template<> struct static_type_mapping<SafeCFunction>
 
 template<> struct julia_type_factory<SafeCFunction>
 {
-  static jl_datatype_t* julia_type() { return (jl_datatype_t*)jlcxx::julia_type("SafeCFunction"); }
+  static jl_datatype_t* julia_type() { return (jl_datatype_t*)core_types().safe_cfunction.get(); }
 };
 
 template<>
@@ -207,6 +210,8 @@ struct MappingTrait<R(*)(ArgsT...)>
   using type = FunctionPtrTrait;
 };
 
+template<typename R, typename...ArgsT> struct IsJuliaObjectType<R(*)(ArgsT...)> : std::true_type {};
+
 /// Implicit conversion to pointer type
 template<typename R, typename...ArgsT> struct static_type_mapping<R(*)(ArgsT...)>
 {
@@ -219,7 +224,7 @@ template<typename R, typename...ArgsT> struct julia_type_factory<R(*)(ArgsT...)>
   {
     create_if_not_exists<R>();
     (create_if_not_exists<ArgsT>(), ...);
-    return (jl_datatype_t*)jlcxx::julia_type("SafeCFunction");
+    return (jl_datatype_t*)core_types().safe_cfunction.get();
   }
 };
 
@@ -0,0 +1,36 @@
+#ifndef JLCXX_METADATA_CACHE_HPP
+#define JLCXX_METADATA_CACHE_HPP
+
+#include <optional>
+#include <string>
+
+#include "jlcxx_config.hpp"
+#include "module.hpp"
+
+// This header provides serialization of the metadata exported by a module, keyed by the build of the wrapper library and the settings
+// that change what is exported. The loader reads the metadata back instead of exporting the functions, and only fetches the function pointers.
+
+namespace jlcxx
+{
+
+/// Identifies the build of the shared library containing address: the GNU build ID where available,
+/// otherwise derived from the path, size and modification time of the library file
+JLCXX_API std::string library_build_id(const void* address);
+
+/// Process-independent description of the exported functions (names, override modules, docs, signatures as type names, argument names
+/// and default values as Julia code) and box types. It has the content of the CppFunctionInfo list except for the function pointers.
+JLCXX_API std::string module_metadata(const Module& mod);
+
+/// Write the build ID, the settings and the metadata of the module to the cache file at path
+JLCXX_API void write_metadata_cache(const Module& mod, const std::string& path);
+
+/// True if the cache file exists and was written for the same build of the wrapper library and libcxxwrap_julia, with the same
+/// JLCXX_LAZY_STL and call statistics settings. Doesn't export the module.
+JLCXX_API bool metadata_cache_is_valid(const Module& mod, const std::string& path);
+
+/// The metadata stored in the cache file, in the format of module_metadata, or nothing if the cache is missing or not valid
+JLCXX_API std::optional<std::string> read_metadata_cache(const Module& mod, const std::string& path);
+
+}
+
+#endif
@@ -1,16 +1,25 @@
 #ifndef JLCXX_MODULE_HPP
 #define JLCXX_MODULE_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <functional>
 #include <map>
 #include <memory>
+#include <new>
 #include <string>
+#include <span>
 #include <sstream>
+#include <tuple>
 #include <typeinfo>
+#include <unordered_map>
 #include <vector>
 
 #include "array.hpp"
+#include "async.hpp"
 #include "attr.hpp"
 #include "type_conversion.hpp"
 
@@ -31,54 +40,221 @@ JLCXX_API jl_datatype_t* new_bitstype(jl_sym_t *name,
                             jl_datatype_t *super,
                             jl_svec_t *parameters, const size_t nbits);
 
+/// Function that converts the C++ exception currently being handled to a Julia exception object, or returns nullptr if it doesn't apply
+using exception_translator_t = std::function<jl_value_t*()>;
+
+/// Add a translator, which takes precedence over the ones registered earlier
+JLCXX_API void register_exception_translator(exception_translator_t translator);
+
+/// Add a translator that only applies to the exceptions for which matches returns true, which must only depend on the type of
+/// the current exception. Where the type of a thrown exception can be determined (GCC and Clang), matches is only called once
+/// per thrown type and the translators that don't apply are skipped, so translating doesn't rethrow once per translator.
+/// A translator registered earlier with the same matches function is replaced, so register_exception can run on every module load.
+JLCXX_API void register_exception_translator(bool (*matches)(), exception_translator_t translator);
+
+/// Convert the C++ exception currently being handled to a Julia exception object. Must be called from inside a catch block.
+/// Exceptions without a registered translator, or whose translator throws, become an ErrorException with the what() message.
+JLCXX_API jl_value_t* current_exception_to_julia();
+
+/// Throw this from a wrapped function to pass a Julia exception, e.g. jl_exception_occurred() after jl_call, unchanged to the Julia caller.
+/// The exception must stay rooted until then, which is the case for jl_exception_occurred() if no other Julia code runs.
+class JLCXX_API JuliaError : public std::exception
+{
+public:
+  explicit JuliaError(jl_value_t* julia_exception) : m_julia_exception(julia_exception) {}
+
+  jl_value_t* julia_exception() const { return m_julia_exception; }
+
+  const char* what() const noexcept override { return "Julia exception"; }
+
+private:
+  jl_value_t* m_julia_exception;
+};
+
+namespace detail
+{
+  /// True if the exception currently being handled is an ExceptionT or derives from it
+  template<typename ExceptionT>
+  bool current_exception_is()
+  {
+    try
+    {
+      throw;
+    }
+    catch(const ExceptionT&)
+    {
+      return true;
+    }
+    catch(...)
+    {
+      return false;
+    }
+  }
+}
+
+/// Throw the given prebuilt Julia exception object whenever a C++ exception of type ExceptionT (or a derived type) escapes a wrapped function
+template<typename ExceptionT>
+void register_exception(jl_value_t* julia_exception)
+{
+  protect_from_gc_permanently(julia_exception);
+  register_exception_translator(detail::current_exception_is<ExceptionT>, [julia_exception] () -> jl_value_t*
+  {
+    return julia_exception;
+  });
+}
+
+/// Build the Julia exception for a C++ exception of type ExceptionT (or a derived type) using the functor f, with signature jl_value_t*(const ExceptionT&)
+template<typename ExceptionT, typename FunctorT>
+void register_exception(FunctorT&& f)
+{
+  register_exception_translator(detail::current_exception_is<ExceptionT>, [f = std::forward<FunctorT>(f)] () -> jl_value_t*
+  {
+    try
+    {
+      throw;
+    }
+    catch(const ExceptionT& e)
+    {
+      return f(e);
+    }
+    catch(...)
+    {
+      return nullptr;
+    }
+  });
+}
+
 /// Some helper functions
 namespace detail
 {
 
 // Need to treat void specially
-template<typename R, typename... Args>
+template<typename FunctorT, typename R, typename... Args>
 struct ReturnTypeAdapter
 {
   using return_type = decltype(convert_to_julia(std::declval<R>()));
+  static constexpr bool is_nothrow = noexcept(convert_to_julia(std::declval<const FunctorT&>()(convert_to_cpp<Args>(std::declval<static_julia_type<Args>>())...)));
 
-  inline return_type operator()(const void* functor, static_julia_type<Args>... args)
+  inline return_type operator()(const void* functor, static_julia_type<Args>... args) noexcept(is_nothrow)
   {
-    auto std_func = reinterpret_cast<const std::function<R(Args...)>*>(functor);
-    assert(std_func != nullptr);
-    return convert_to_julia((*std_func)(convert_to_cpp<Args>(args)...));
+    auto func = reinterpret_cast<const FunctorT*>(functor);
+    assert(func != nullptr);
+    return convert_to_julia((*func)(convert_to_cpp<Args>(args)...));
   }
 };
 
-template<typename... Args>
-struct ReturnTypeAdapter<void, Args...>
+template<typename FunctorT, typename... Args>
+struct ReturnTypeAdapter<FunctorT, void, Args...>
 {
-  inline void operator()(const void* functor, static_julia_type<Args>... args)
+  static constexpr bool is_nothrow = noexcept(std::declval<const FunctorT&>()(convert_to_cpp<Args>(std::declval<static_julia_type<Args>>())...));
+
+  inline void operator()(const void* functor, static_julia_type<Args>... args) noexcept(is_nothrow)
   {
-    auto std_func = reinterpret_cast<const std::function<void(Args...)>*>(functor);
-    assert(std_func != nullptr);
-    (*std_func)(convert_to_cpp<Args>(args)...);
+    auto func = reinterpret_cast<const FunctorT*>(functor);
+    assert(func != nullptr);
+    (*func)(convert_to_cpp<Args>(args)...);
   }
 };
 
-/// Call a C++ std::function, passed as a void pointer since it comes from Julia
-template<typename R, typename... Args>
-struct CallFunctor
+/// Call a C++ functor of type FunctorT, passed as a void pointer since it comes from Julia.
+/// Each functor type gets its own static apply function, so the call to the functor itself is direct.
+/// If neither the functor nor the argument and return value conversions can throw, no exception handler is generated.
+template<typename FunctorT, typename R, typename... Args>
+struct CallStoredFunctor
 {
-  using return_type = typename std::remove_const<decltype(ReturnTypeAdapter<R, Args...>()(std::declval<const void*>(), std::declval<static_julia_type<Args>>()...))>::type;
+  using adapter_t = ReturnTypeAdapter<FunctorT, R, Args...>;
+  using return_type = typename std::remove_const<decltype(adapter_t()(std::declval<const void*>(), std::declval<static_julia_type<Args>>()...))>::type;
 
   static return_type apply(const void* functor, static_julia_type<Args>... args)
   {
-    try
+    if constexpr (adapter_t::is_nothrow)
     {
-      return ReturnTypeAdapter<R, Args...>()(functor, args...);
+      return adapter_t()(functor, args...);
     }
-    catch(const std::exception& err)
+    else
     {
-      jl_error(err.what());
+      jl_value_t* julia_exception = nullptr;
+      try
+      {
+        return adapter_t()(functor, args...);
+      }
+      catch(...)
+      {
+        julia_exception = current_exception_to_julia();
+      }
+      // Thrown outside of the catch block, so the C++ exception is destroyed before the Julia exception unwinds the stack
+      jl_throw(julia_exception);
+      return return_type();
     }
+  }
+};
 
-    return return_type();
+/// Call a C++ std::function, passed as a void pointer since it comes from Julia
+template<typename R, typename... Args>
+struct CallFunctor : CallStoredFunctor<std::function<R(Args...)>, R, Args...>
+{
+};
+
+/// True for lambdas without captures, which can be recreated on demand and thus don't need to be passed as a thunk
+template<typename LambdaT, typename R, typename... Args>
+constexpr bool is_captureless_lambda = std::is_empty<LambdaT>::value && std::is_default_constructible<LambdaT>::value && std::is_convertible<LambdaT, R(*)(Args...)>::value;
+
+/// Call a captureless lambda without thunk argument, so Julia can ccall the result directly like a plain function pointer
+template<typename LambdaT, typename R, typename... Args>
+struct CallCapturelessLambda
+{
+  using return_type = typename CallStoredFunctor<LambdaT, R, Args...>::return_type;
+
+  static return_type apply(static_julia_type<Args>... args)
+  {
+    const LambdaT lambda{};
+    return CallStoredFunctor<LambdaT, R, Args...>::apply(&lambda, args...);
+  }
+};
+
+/// Switch the current thread to the GC-safe state for the lifetime of the object, so the garbage collector can run concurrently.
+/// No Julia objects may be accessed in the meantime.
+class GCSafeRegion
+{
+public:
+  GCSafeRegion()
+  {
+#if (JULIA_VERSION_MAJOR * 100 + JULIA_VERSION_MINOR) >= 107
+    m_ptls = jl_current_task->ptls;
+#else
+    m_ptls = jl_get_ptls_states();
+#endif
+    m_state = jl_gc_safe_enter(m_ptls);
+  }
+
+  ~GCSafeRegion()
+  {
+    jl_gc_safe_leave(m_ptls, m_state);
+  }
+
+  GCSafeRegion(const GCSafeRegion&) = delete;
+  GCSafeRegion& operator=(const GCSafeRegion&) = delete;
+
+private:
+  jl_ptls_t m_ptls;
+  int8_t m_state;
+};
+
+/// Call FunctorT in a GC-safe region, used for functions marked jlcxx::gc_safe.
+/// Arguments are converted before entering the region and the result is converted after leaving it, also when an exception is thrown.
+template<typename FunctorT, typename R, typename... Args>
+struct GCSafeFunctor
+{
+  static_assert(!IsJuliaObjectType<remove_const_ref<R>>::value && !(IsJuliaObjectType<remove_const_ref<Args>>::value || ...),
+    "Functions marked gc_safe can't take or return Julia objects");
+
+  R operator()(Args... args) const noexcept(noexcept(std::declval<const FunctorT&>()(std::declval<Args>()...)))
+  {
+    GCSafeRegion gc_safe_region;
+    return functor(std::forward<Args>(args)...);
   }
+
+  FunctorT functor;
 };
 
 /// Make a vector with the types in the variadic template parameter pack
@@ -88,6 +264,45 @@ std::vector<jl_datatype_t*> argtype_vector()
   return {julia_type<Args>()...};
 }
 
+/// Type of the argument in the ccall signature. Wrapped C++ objects passed by value are dispatched on their
+/// Julia type, but the C++ function receives the pointer stored in their cpp_object field.
+template<typename T>
+jl_datatype_t* ccall_argument_type()
+{
+  if constexpr (std::is_same<static_julia_type<T>, WrappedCppPtr>::value && !std::is_reference<T>::value && !std::is_pointer<T>::value)
+  {
+    return jl_voidpointer_type;
+  }
+  else
+  {
+    return julia_type<T>();
+  }
+}
+
+/// Make a vector with the ccall types of the variadic template parameter pack
+template<typename... Args>
+std::vector<jl_datatype_t*> ccall_argtype_vector()
+{
+  return {ccall_argument_type<Args>()...};
+}
+
+/// True if T can be passed to a vectorized kernel as an element of an ArrayRef without any conversion
+template<typename T>
+constexpr bool is_vectorizable = !(std::is_reference<T>::value && !std::is_const<std::remove_reference_t<T>>::value)
+  && !std::is_pointer<remove_const_ref<T>>::value
+  && IsMirroredType<remove_const_ref<T>>::value
+  && std::is_same<static_julia_type<remove_const_ref<T>>, remove_const_ref<T>>::value;
+
+/// Elementwise loop used by Module::method_vectorized, written on plain pointers so the compiler can vectorize it
+template<typename F, typename R, typename... Args>
+void vectorized_loop(const F& f, R* out, const std::size_t n, const Args*... in)
+{
+  for(std::size_t i = 0; i != n; ++i)
+  {
+    out[i] = f(in[i]...);
+  }
+}
+
 template<typename... Args>
 struct NeedConvertHelper
 {
@@ -126,6 +341,53 @@ BoxedValue<T> create(ArgsT&&... args)
   return boxed_cpp_pointer(cpp_obj, dt, finalize);
 }
 
+namespace detail
+{
+
+/// Storage for the arguments of an async call: copies, also of const references, since the Julia objects they refer to may be
+/// collected while the call runs. The copies are destroyed on the worker thread when the call is done.
+template<typename T>
+using async_argument_t = std::decay_t<T>;
+
+/// Pass a stored argument on as an lvalue for const reference parameters and as an rvalue otherwise
+template<typename T>
+decltype(auto) stored_async_argument(async_argument_t<T>& stored)
+{
+  if constexpr (std::is_lvalue_reference<T>::value)
+  {
+    return (stored);
+  }
+  else
+  {
+    return std::move(stored);
+  }
+}
+
+/// Start an async call of f on the thread pool, returning the handle to Julia
+template<typename R, typename... Args, typename FunctorT>
+BoxedValue<AsyncCall> start_async_call(const FunctorT& f, Args... args)
+{
+  AsyncCall* call = new AsyncCall();
+  BoxedValue<AsyncCall> result = boxed_cpp_pointer(call, julia_type<AsyncCall>(), true);
+  call->start([&f, stored_args = std::tuple<async_argument_t<Args>...>(std::forward<Args>(args)...)] () mutable -> AsyncCall::result_boxer_t
+  {
+    auto call_f = [&f] (async_argument_t<Args>&... stored) -> decltype(auto) { return f(stored_async_argument<Args>(stored)...); };
+    if constexpr (std::is_void<R>::value)
+    {
+      std::apply(call_f, stored_args);
+      return nullptr;
+    }
+    else
+    {
+      auto value = std::make_shared<R>(std::apply(call_f, stored_args));
+      return [value] () -> jl_value_t* { return box<R>(*value); };
+    }
+  });
+  return result;
+}
+
+} // end namespace detail
+
 /// Safe upcast to base type
 template<typename T>
 struct UpCast
@@ -142,14 +404,71 @@ extern jl_datatype_t* g_cppfunctioninfo_type;
 
 class JLCXX_API Module;
 
-/// Abstract base class for storing any function
+/// Turn call statistics on or off. Only affects modules registered afterwards, since it selects the function pointers passed to Julia.
+/// Enabled at startup if the environment variable JLCXX_CALL_STATISTICS is set.
+JLCXX_API void set_call_statistics_enabled(const bool enabled);
+JLCXX_API bool call_statistics_enabled();
+
+/// Number of calls, total time and a latency histogram for a wrapped function
+struct CallStatistics
+{
+  /// Bucket i of the histogram counts calls taking between 4^i and 4^(i+1) ns, the last bucket also counts all slower calls
+  static constexpr std::size_t nb_buckets = 16;
+
+  static std::size_t bucket(uint64_t ns)
+  {
+    std::size_t i = 0;
+    while(ns >= 4 && i != nb_buckets-1)
+    {
+      ns >>= 2;
+      ++i;
+    }
+    return i;
+  }
+
+  void record(const uint64_t ns)
+  {
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+    histogram[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void reset()
+  {
+    nb_calls = 0;
+    total_ns = 0;
+    for(auto& count : histogram)
+    {
+      count = 0;
+    }
+  }
+
+  std::atomic<uint64_t> nb_calls{0};
+  std::atomic<uint64_t> total_ns{0};
+  std::array<std::atomic<uint64_t>, nb_buckets> histogram{};
+};
+
+namespace detail
+{
+  /// Get the GC-protected Julia string with the given content. It is created the first time and shared afterwards, so only use this for repeated strings such as argument names.
+  JLCXX_API jl_value_t* interned_string(const char* str);
+}
+
+/// Abstract base class for storing any function. Since version 0.13, subclasses implement resolve_argument_types instead of overriding argument_types.
 class JLCXX_API FunctionWrapperBase
 {
 public:
   FunctionWrapperBase(Module* mod, std::pair<jl_datatype_t*,jl_datatype_t*> return_type);
 
-  /// Types of the arguments (used in the wrapper signature)
-  virtual std::vector<jl_datatype_t*> argument_types() const = 0;
+  /// Types of the arguments (used in the wrapper signature). Resolved on first use, since this may create types, and cached afterwards.
+  std::span<jl_datatype_t* const> argument_types() const;
+
+  /// Types of the arguments as passed to the function returned by pointer(), for generating static ccall stubs.
+  /// Defaults to argument_types(), which is correct when no argument is a wrapped C++ type.
+  virtual std::vector<jl_datatype_t*> ccall_argument_types() const
+  {
+    const auto types = argument_types();
+    return std::vector<jl_datatype_t*>(types.begin(), types.end());
+  }
 
   /// Return type
   std::pair<jl_datatype_t*,jl_datatype_t*> return_type() const { return m_return_type; }
@@ -160,7 +479,11 @@ public:
 
   inline void set_name(jl_value_t* name)
   {
-    protect_from_gc(name);
+    // Symbols are never garbage collected
+    if(!jl_is_symbol(name))
+    {
+      protect_from_gc_permanently(name);
+    }
     m_name = name;
   }
 
@@ -171,40 +494,24 @@ public:
 
   inline void set_doc(jl_value_t* doc)
   {
-    protect_from_gc(doc);
+    protect_from_gc_permanently(doc);
     m_doc = doc;
   }
 
+  /// Set the docstring from a C++ string, sharing a single Julia string between all functions without docstring
+  void set_doc(const std::string& doc);
+
   inline jl_value_t* doc() const
   {
     return m_doc;
   }
 
-  void set_extra_argument_data(std::vector<arg>&& posArgs, std::vector<kwarg>&& kwArgs)
-  {
-    m_number_of_keyword_args = kwArgs.size();
-
-    // gather all argument names
-    m_argument_names.clear();
-    for(auto& a: posArgs)
-      m_argument_names.push_back(jl_cstr_to_string(a.name));
-    for(auto& a: kwArgs)
-      m_argument_names.push_back(jl_cstr_to_string(a.name));
-    // ensure the Julia GC doesn't throw away our strings:
-    for(auto& s: m_argument_names)
-      protect_from_gc(s);
-
-    // gather all default values
-    m_argument_default_values.clear();
-    for(auto& a: posArgs)
-      m_argument_default_values.push_back(a.defaultValue);
-    for(auto& a: kwArgs)
-      m_argument_default_values.push_back(a.defaultValue);
-  }
+  /// Store the argument names, as interned strings, and the default values
+  void set_extra_argument_data(std::vector<arg>&& posArgs, std::vector<kwarg>&& kwArgs);
 
-  const std::vector<jl_value_t*>& argument_names() const {return m_argument_names;}
+  std::span<jl_value_t* const> argument_names() const {return m_argument_names;}
   int number_of_keyword_arguments() const {return m_number_of_keyword_args;}
-  const std::vector<jl_value_t*>& argument_default_values() const {return m_argument_default_values;}
+  std::span<jl_value_t* const> argument_default_values() const {return m_argument_default_values;}
 
   inline void set_override_module(jl_module_t* mod) { m_override_module = (jl_value_t*)mod; }
   inline jl_value_t* override_module() const { return m_override_module; }
@@ -212,23 +519,79 @@ public:
   /// Function pointer as void*, since that's what Julia expects
   virtual void *pointer() = 0;
 
-  /// The thunk (i.e. std::function) to pass as first argument to the function pointed to by function_pointer
+  /// The thunk (i.e. the stored std::function or lambda) to pass as first argument to the function pointed to by function_pointer
   virtual void *thunk() = 0;
 
+  /// Function with the same signature as the one returned by pointer(), but recording call statistics. Takes this wrapper as thunk.
+  virtual void* profiled_pointer() { return nullptr; }
+
+  /// Allocate the statistics, if needed. Called before passing profiled_pointer to Julia, so the statistics don't take space in every wrapper.
+  void enable_statistics();
+
+  /// The recorded statistics, null unless enable_statistics was called
+  CallStatistics* statistics() { return m_statistics.get(); }
+  const CallStatistics* statistics() const { return m_statistics.get(); }
+
+protected:
+  /// Compute the argument types, called once by argument_types()
+  virtual std::vector<jl_datatype_t*> resolve_argument_types() const = 0;
+
 private:
   jl_value_t* m_name = nullptr;
   jl_value_t* m_doc = nullptr;
-  std::vector<jl_value_t*> m_argument_names;
+  // Argument metadata is stored in the arena of m_module, like the wrapper itself
+  std::span<jl_value_t* const> m_argument_names;
   int m_number_of_keyword_args = 0;
-  std::vector<jl_value_t*> m_argument_default_values;
+  std::span<jl_value_t* const> m_argument_default_values;
   Module* m_module;
   std::pair<jl_datatype_t*,jl_datatype_t*> m_return_type = std::make_pair(nullptr,nullptr);
+  mutable std::span<jl_datatype_t* const> m_argument_types;
+  mutable bool m_argument_types_resolved = false;
 
   // The module in which the function is overridden, e.g. jl_base_module when trying to override Base.getindex.
   jl_value_t* m_override_module = nullptr;
 
+  std::unique_ptr<CallStatistics> m_statistics;
 };
 
+namespace detail
+{
+
+/// Trampoline returned by profiled_pointer. The thunk is the FunctionWrapperBase, which provides the statistics (allocated by enable_statistics)
+/// and the function to call.
+/// Calls ending in a Julia exception are counted, but not timed.
+template<typename ReturnT, typename... JuliaArgsT>
+struct ProfiledCall
+{
+  static ReturnT apply(const void* wrapper_ptr, JuliaArgsT... args)
+  {
+    FunctionWrapperBase& wrapper = *reinterpret_cast<FunctionWrapperBase*>(const_cast<void*>(wrapper_ptr));
+    CallStatistics& statistics = *wrapper.statistics();
+    statistics.nb_calls.fetch_add(1, std::memory_order_relaxed);
+
+    void* thunk = wrapper.thunk();
+    void* f = wrapper.pointer();
+    const auto start = std::chrono::steady_clock::now();
+    const auto record_time = [&] ()
+    {
+      statistics.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    };
+    if constexpr (std::is_void<ReturnT>::value)
+    {
+      thunk == nullptr ? reinterpret_cast<ReturnT(*)(JuliaArgsT...)>(f)(args...) : reinterpret_cast<ReturnT(*)(const void*, JuliaArgsT...)>(f)(thunk, args...);
+      record_time();
+    }
+    else
+    {
+      ReturnT result = thunk == nullptr ? reinterpret_cast<ReturnT(*)(JuliaArgsT...)>(f)(args...) : reinterpret_cast<ReturnT(*)(const void*, JuliaArgsT...)>(f)(thunk, args...);
+      record_time();
+      return result;
+    }
+  }
+};
+
+} // namespace detail
+
 /// Implementation of function storage, case of std::function
 template<typename R, typename... Args>
 class FunctionWrapper : public FunctionWrapperBase
@@ -241,12 +604,17 @@ public:
     (create_if_not_exists<Args>(), ...);
   }
 
-  virtual std::vector<jl_datatype_t*> argument_types() const
+  virtual std::vector<jl_datatype_t*> ccall_argument_types() const
   {
-    return detail::argtype_vector<Args...>();
+    return detail::ccall_argtype_vector<Args...>();
   }
 
 protected:
+  virtual std::vector<jl_datatype_t*> resolve_argument_types() const
+  {
+    return detail::argtype_vector<Args...>();
+  }
+
   virtual void* pointer()
   {
     return reinterpret_cast<void*>(detail::CallFunctor<R, Args...>::apply);
@@ -257,10 +625,79 @@ protected:
     return reinterpret_cast<void*>(&m_function);
   }
 
+  virtual void* profiled_pointer()
+  {
+    return reinterpret_cast<void*>(detail::ProfiledCall<typename detail::CallFunctor<R, Args...>::return_type, static_julia_type<Args>...>::apply);
+  }
+
 private:
   functor_t m_function;
 };
 
+/// Implementation of function storage, case of a lambda or other functor stored by value.
+/// The functor is called directly from a trampoline that is specific to LambdaT, avoiding the std::function indirection.
+/// Captureless lambdas need no thunk at all: their trampoline is exposed as a plain function pointer.
+template<typename LambdaT, typename R, typename... Args>
+class LambdaWrapper : public FunctionWrapperBase
+{
+public:
+  typedef LambdaT functor_t;
+
+  LambdaWrapper(Module* mod, const functor_t& lambda) : FunctionWrapperBase(mod, julia_return_type<R>()), m_lambda(lambda)
+  {
+    (create_if_not_exists<Args>(), ...);
+  }
+
+  LambdaWrapper(Module* mod, functor_t&& lambda) : FunctionWrapperBase(mod, julia_return_type<R>()), m_lambda(std::move(lambda))
+  {
+    (create_if_not_exists<Args>(), ...);
+  }
+
+  virtual std::vector<jl_datatype_t*> ccall_argument_types() const
+  {
+    return detail::ccall_argtype_vector<Args...>();
+  }
+
+protected:
+  virtual std::vector<jl_datatype_t*> resolve_argument_types() const
+  {
+    return detail::argtype_vector<Args...>();
+  }
+
+  virtual void* pointer()
+  {
+    if constexpr (is_captureless)
+    {
+      return reinterpret_cast<void*>(detail::CallCapturelessLambda<LambdaT, R, Args...>::apply);
+    }
+    else
+    {
+      return reinterpret_cast<void*>(detail::CallStoredFunctor<LambdaT, R, Args...>::apply);
+    }
+  }
+
+  virtual void* thunk()
+  {
+    if constexpr (is_captureless)
+    {
+      return nullptr;
+    }
+    else
+    {
+      return reinterpret_cast<void*>(&m_lambda);
+    }
+  }
+
+  virtual void* profiled_pointer()
+  {
+    return reinterpret_cast<void*>(detail::ProfiledCall<typename detail::CallStoredFunctor<LambdaT, R, Args...>::return_type, static_julia_type<Args>...>::apply);
+  }
+
+private:
+  static constexpr bool is_captureless = detail::is_captureless_lambda<LambdaT, R, Args...>;
+  functor_t m_lambda;
+};
+
 /// Implementation of function storage, case of a function pointer
 template<typename R, typename... Args>
 class FunctionPtrWrapper : public FunctionWrapperBase
@@ -273,12 +710,17 @@ public:
     (create_if_not_exists<Args>(), ...);
   }
 
-  virtual std::vector<jl_datatype_t*> argument_types() const
+  virtual std::vector<jl_datatype_t*> ccall_argument_types() const
   {
-    return detail::argtype_vector<Args...>();
+    return detail::ccall_argtype_vector<Args...>();
   }
 
 protected:
+  virtual std::vector<jl_datatype_t*> resolve_argument_types() const
+  {
+    return detail::argtype_vector<Args...>();
+  }
+
   virtual void* pointer()
   {
     return reinterpret_cast<void*>(m_function);
@@ -289,10 +731,106 @@ protected:
     return nullptr;
   }
 
+  virtual void* profiled_pointer()
+  {
+    return reinterpret_cast<void*>(detail::ProfiledCall<R, Args...>::apply);
+  }
+
 private:
   R(*m_function)(Args...);
 };
 
+/// Reuse the function pointer and thunk of an existing wrapper under a different signature.
+/// Used when several Julia argument types map to the same ccall type, e.g. T& and T* both map to WrappedCppPtr
+template<typename R, typename... Args>
+class FunctionAliasWrapper : public FunctionWrapperBase
+{
+public:
+  FunctionAliasWrapper(Module* mod, FunctionWrapperBase& target) : FunctionWrapperBase(mod, target.return_type()), m_target(target)
+  {
+    (create_if_not_exists<Args>(), ...);
+  }
+
+  virtual std::vector<jl_datatype_t*> ccall_argument_types() const
+  {
+    return detail::ccall_argtype_vector<Args...>();
+  }
+
+protected:
+  virtual std::vector<jl_datatype_t*> resolve_argument_types() const
+  {
+    return detail::argtype_vector<Args...>();
+  }
+
+  virtual void* pointer()
+  {
+    return m_target.pointer();
+  }
+
+  virtual void* thunk()
+  {
+    return m_target.thunk();
+  }
+
+  virtual void* profiled_pointer()
+  {
+    return m_target.profiled_pointer();
+  }
+
+private:
+  FunctionWrapperBase& m_target;
+};
+
+namespace detail
+{
+
+/// Allocates objects that live as long as their Module in large blocks, avoiding an allocation per object.
+/// The objects are destroyed together with the arena, in reverse order of creation.
+class JLCXX_API ObjectArena
+{
+public:
+  ObjectArena() = default;
+  ObjectArena(const ObjectArena&) = delete;
+  ObjectArena& operator=(const ObjectArena&) = delete;
+  ~ObjectArena();
+
+  template<typename T, typename... ArgsT>
+  T* create(ArgsT&&... args)
+  {
+    T* result = new(allocate(sizeof(T), alignof(T))) T(std::forward<ArgsT>(args)...);
+    if constexpr (!std::is_trivially_destructible<T>::value)
+    {
+      m_destructors.emplace_back(result, [] (void* p) { static_cast<T*>(p)->~T(); });
+    }
+    return result;
+  }
+
+  /// Copy the values to an array in the arena
+  template<typename T>
+  std::span<const T> copy_array(const std::vector<T>& values)
+  {
+    static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value, "Arena arrays are never destroyed");
+    if(values.empty())
+    {
+      return std::span<const T>();
+    }
+    T* data = static_cast<T*>(allocate(sizeof(T)*values.size(), alignof(T)));
+    std::copy(values.begin(), values.end(), data);
+    return std::span<const T>(data, values.size());
+  }
+
+private:
+  void* allocate(const std::size_t size, const std::size_t alignment);
+
+  static constexpr std::size_t block_size = 64*1024;
+  std::vector<std::unique_ptr<char[]>> m_blocks;
+  void* m_free = nullptr;
+  std::size_t m_free_size = 0;
+  std::vector<std::pair<void*, void(*)(void*)>> m_destructors;
+};
+
+} // namespace detail
+
 /// Indicate that a parametric type is to be added
 template<typename... ParametersT>
 struct Parametric
@@ -348,7 +886,7 @@ struct GetJlType<const T>
 {
   jl_value_t* operator()() const
   {
-    return (jl_value_t*)apply_type(jlcxx::julia_type("CxxConst"), (jl_datatype_t*)GetJlType<T>()());
+    return (jl_value_t*)apply_type(core_types().cxx_const, (jl_datatype_t*)GetJlType<T>()());
   }
 };
 
@@ -370,7 +908,6 @@ inline jl_value_t* make_fname(const std::string& nametype, ArgsT... args)
   jl_value_t* name = nullptr;
   JL_GC_PUSH1(&name);
   name = jl_new_struct((jl_datatype_t*)julia_type(nametype), args...);
-  protect_from_gc(name);
   JL_GC_POP();
 
   return name;
@@ -547,6 +1084,12 @@ struct DefaultConstructible : std::bool_constant<std::is_default_constructible<T
 {
 };
 
+/// AsyncCall objects are only created by calling an async function
+template<>
+struct DefaultConstructible<AsyncCall> : std::false_type
+{
+};
+
 /// Trait to allow user-controlled disabling of the copy constructor
 template <typename T>
 struct CopyConstructible : std::bool_constant<std::is_copy_constructible<T>::value && !std::is_abstract<T>::value>
@@ -560,15 +1103,12 @@ public:
 
   Module(jl_module_t* jl_mod);
 
+  /// Add a function allocated with new. The module takes ownership, as in versions before 0.13.
   void append_function(FunctionWrapperBase* f)
   {
     assert(f != nullptr);
-    m_functions.push_back(std::shared_ptr<FunctionWrapperBase>(f));
-    assert(m_functions.back() != nullptr);
-    if(m_override_module != nullptr)
-    {
-      m_functions.back()->set_override_module(m_override_module);
-    }
+    m_owned_functions.emplace_back(f);
+    append_arena_function(f);
   }
 
   /// Define a new function
@@ -577,8 +1117,20 @@ public:
   {
     static_assert(detail::check_extra_argument_count<Extra...>(sizeof...(Args)), "Wrong number of annotated arguments (jlcxx::arg and jlcxx::kwarg arguments)!");
 
+    detail::RegistrationPhase phase("method", name.c_str());
     detail::ExtraFunctionData extraData = detail::parse_attributes(extra...);
-    return method_helper(name, f, extraData);
+    if constexpr (detail::has_gc_safe<Extra...>)
+    {
+      return gc_safe_helper<R, Args...>(name, std::move(f), std::move(extraData));
+    }
+    else if constexpr (detail::has_async<Extra...>)
+    {
+      return async_helper<R, Args...>(name, std::move(f), std::move(extraData));
+    }
+    else
+    {
+      return method_helper(name, f, std::move(extraData));
+    }
   }
 
   /// Define a new function. Overload for pointers
@@ -587,7 +1139,17 @@ public:
   {
     static_assert(detail::check_extra_argument_count<Extra...>(sizeof...(Args)), "Wrong number of annotated arguments (jlcxx::arg and jlcxx::kwarg arguments)!");
 
+    detail::RegistrationPhase phase("method", name.c_str());
     detail::ExtraFunctionData extraData = detail::parse_attributes<true>(extra...);
+    if constexpr (detail::has_gc_safe<Extra...>)
+    {
+      return gc_safe_helper<R, Args...>(name, f, std::move(extraData));
+    }
+    if constexpr (detail::has_async<Extra...>)
+    {
+      return async_helper<R, Args...>(name, f, std::move(extraData));
+    }
+
     const bool need_convert = bool(extraData.force_convert) || detail::NeedConvertHelper<R, Args...>()();
 
     // Conversion is automatic when using the std::function calling method, so if we need conversion we use that
@@ -597,12 +1159,7 @@ public:
     }
 
     // No conversion needed -> call can be through a naked function pointer
-    auto* new_wrapper = new FunctionPtrWrapper<R, Args...>(this, f);
-    new_wrapper->set_name((jl_value_t*)jl_symbol(name.c_str()));
-    new_wrapper->set_doc(jl_cstr_to_string(extraData.doc.c_str()));
-    new_wrapper->set_extra_argument_data(std::move(extraData.positionalArguments), std::move(extraData.keywordArguments));
-    append_function(new_wrapper);
-    return *new_wrapper;
+    return register_function(m_arena.create<FunctionPtrWrapper<R, Args...>>(this, f), name, std::move(extraData));
   }
 
   /// Define a new function. Overload for lambda
@@ -610,8 +1167,35 @@ public:
            std::enable_if_t<detail::has_call_operator<LambdaT>::value && !std::is_member_function_pointer<LambdaT>::value, bool> = true>
   FunctionWrapperBase& method(const std::string& name, LambdaT&& lambda, Extra... extra)
   {
+    detail::RegistrationPhase phase("method", name.c_str());
     detail::ExtraFunctionData extraData = detail::parse_attributes(extra...);
-    return lambda_helper(name, std::forward<LambdaT>(lambda), &LambdaT::operator(), std::move(extraData));
+    if constexpr (detail::has_gc_safe<Extra...> || detail::has_async<Extra...>)
+    {
+      return policy_lambda_helper<detail::has_async<Extra...>>(name, std::forward<LambdaT>(lambda), &LambdaT::operator(), std::move(extraData));
+    }
+    else
+    {
+      return lambda_helper(name, std::forward<LambdaT>(lambda), &LambdaT::operator(), std::move(extraData));
+    }
+  }
+
+  /// Define a scalar function, together with a kernel named name! that applies it elementwise to arrays: name!(in1, ..., inN, out).
+  /// Broadcasting over a large array then takes a single call. Argument and return types must be bits types that need no conversion.
+  /// The extra arguments (names, docstring, ...) only apply to the scalar version.
+  template<typename R, typename... Args, typename... Extra>
+  FunctionWrapperBase& method_vectorized(const std::string& name, R(*f)(Args...), Extra... extra)
+  {
+    FunctionWrapperBase& scalar_wrapper = method(name, f, extra...);
+    add_vectorized_kernel<R, Args...>(name, f);
+    return scalar_wrapper;
+  }
+
+  /// Vectorized function defined using a lambda. Prefer this over a function pointer, since the lambda can be inlined into the loop
+  template<typename LambdaT, typename... Extra,
+           std::enable_if_t<detail::has_call_operator<LambdaT>::value && !std::is_member_function_pointer<LambdaT>::value, bool> = true>
+  FunctionWrapperBase& method_vectorized(const std::string& name, LambdaT&& lambda, Extra... extra)
+  {
+    return vectorized_lambda_helper(name, std::forward<LambdaT>(lambda), &std::decay_t<LambdaT>::operator(), extra...);
   }
 
   /// Add a constructor with the given argument types for the given datatype (used to get the name)
@@ -623,8 +1207,6 @@ public:
     detail::ExtraFunctionData extraData = detail::parse_attributes<false,true>(extra...);
     FunctionWrapperBase &new_wrapper = bool(extraData.finalize) ? add_lambda("dummy", [](ArgsT... args) { return create<T, true>(args...); }, std::move(extraData)) : add_lambda("dummy", [](ArgsT... args) { return create<T, false>(args...); }, std::move(extraData));
     new_wrapper.set_name(detail::make_fname("ConstructorFname", dt));
-    new_wrapper.set_doc(jl_cstr_to_string(extraData.doc.c_str()));
-    new_wrapper.set_extra_argument_data(std::move(extraData.positionalArguments), std::move(extraData.keywordArguments));
   }
 
   template<typename T, typename R, typename LambdaT, typename... ArgsT, typename... Extra>
@@ -671,6 +1253,11 @@ public:
     return *m_functions.back();
   }
 
+  std::size_t num_functions() const
+  {
+    return m_functions.size();
+  }
+
   /// Add a composite type
   template<typename T, typename SuperParametersT=ParameterList<>, typename JLSuperT=jl_datatype_t>
   TypeWrapper<T> add_type(const std::string& name, JLSuperT* super = jl_any_type);
@@ -739,6 +1326,28 @@ public:
   inline void set_override_module(jl_module_t* mod) { m_override_module = mod; }
   inline void unset_override_module() { m_override_module = nullptr; }
 
+  /// In lazy export mode, argument types are not resolved at registration and Julia only receives the function names when loading the module.
+  /// The functions with a given name are requested when that name is first called, see get_module_function_names in c_interface.cpp
+  inline void set_lazy_export(const bool lazy) { m_lazy_export = lazy; }
+  inline bool lazy_export() const { return m_lazy_export; }
+
+  /// Number of functions passed to Julia by get_module_functions_from. Functions added afterwards, e.g. by a deferred type applied while another
+  /// module is registered, are exported with get_unexported_module_functions.
+  inline void set_nb_exported_functions(const std::size_t n) { m_nb_exported_functions = std::max(m_nb_exported_functions, n); }
+  inline std::size_t nb_exported_functions() const { return m_nb_exported_functions; }
+
+  /// Address of the registration function, used to identify the wrapper library
+  inline void set_library_address(const void* address) { m_library_address = address; }
+  inline const void* library_address() const { return m_library_address; }
+
+  /// Group the functions added since the previous call by name and override module, returning the index of the first new group
+  std::size_t update_function_groups();
+
+  std::size_t nb_function_groups() const { return m_function_groups.size(); }
+
+  /// Functions in group i, all sharing the same name and override module
+  const std::vector<FunctionWrapperBase*>& function_group(const std::size_t i) const { return m_function_groups.at(i); }
+
 private:
 
   template<typename T>
@@ -768,34 +1377,123 @@ private:
   }
 
   template<typename R, typename LambdaT, typename... ArgsT>
-  FunctionWrapperBase& lambda_helper(const std::string& name, LambdaT&& lambda, R(LambdaT::*)(ArgsT...) const, detail::ExtraFunctionData&& extraData)
+  FunctionWrapperBase& lambda_helper(const std::string& name, LambdaT&& lambda, R(std::decay_t<LambdaT>::*)(ArgsT...) const, detail::ExtraFunctionData&& extraData)
+  {
+    using lambda_t = std::decay_t<LambdaT>;
+    return register_function(m_arena.create<LambdaWrapper<lambda_t, R, ArgsT...>>(this, std::forward<LambdaT>(lambda)), name, std::move(extraData));
+  }
+
+  /// Extract the signature of a lambda for gc_safe_helper or async_helper
+  template<bool IsAsync, typename R, typename LambdaT, typename... ArgsT>
+  FunctionWrapperBase& policy_lambda_helper(const std::string& name, LambdaT&& lambda, R(std::decay_t<LambdaT>::*)(ArgsT...) const, detail::ExtraFunctionData&& extraData)
+  {
+    if constexpr (IsAsync)
+    {
+      return async_helper<R, ArgsT...>(name, std::forward<LambdaT>(lambda), std::move(extraData));
+    }
+    else
+    {
+      return gc_safe_helper<R, ArgsT...>(name, std::forward<LambdaT>(lambda), std::move(extraData));
+    }
+  }
+
+  /// Store any callable f in a functor that calls it in a GC-safe region
+  template<typename R, typename... Args, typename FunctorT>
+  FunctionWrapperBase& gc_safe_helper(const std::string& name, FunctorT&& f, detail::ExtraFunctionData&& extraData)
+  {
+    using functor_t = detail::GCSafeFunctor<std::decay_t<FunctorT>, R, Args...>;
+    return register_function(m_arena.create<LambdaWrapper<functor_t, R, Args...>>(this, functor_t{std::forward<FunctorT>(f)}), name, std::move(extraData));
+  }
+
+  /// Register a function returning an AsyncCall handle that runs f on the async thread pool
+  template<typename R, typename... Args, typename FunctorT>
+  FunctionWrapperBase& async_helper(const std::string& name, FunctorT&& f, detail::ExtraFunctionData&& extraData)
+  {
+    static_assert(!std::is_reference<R>::value, "Functions marked async must return by value");
+    static_assert((std::is_copy_constructible<std::decay_t<Args>>::value && ...), "Arguments of functions marked async are copied, so they must be copy constructible");
+    static_assert(!((std::is_lvalue_reference<Args>::value && !std::is_const<std::remove_reference_t<Args>>::value) || ...),
+      "Functions marked async work on copies of their arguments, so they can't take non-const references (this includes non-const methods). Pass a pointer instead");
+    static_assert(!IsJuliaObjectType<remove_const_ref<R>>::value && !(IsJuliaObjectType<remove_const_ref<Args>>::value || ...),
+      "Functions marked async can't take or return Julia objects");
+    return add_lambda(name, [f = std::forward<FunctorT>(f)] (Args... args)
+    {
+      return detail::start_async_call<R, Args...>(f, std::forward<Args>(args)...);
+    }, std::move(extraData));
+  }
+
+  template<typename R, typename LambdaT, typename... ArgsT, typename... Extra>
+  FunctionWrapperBase& vectorized_lambda_helper(const std::string& name, LambdaT&& lambda, R(std::decay_t<LambdaT>::*)(ArgsT...) const, Extra... extra)
   {
-    return method_helper(name, std::function<R(ArgsT...)>(std::forward<LambdaT>(lambda)), std::move(extraData));
+    std::decay_t<LambdaT> kernel_lambda = lambda;
+    FunctionWrapperBase& scalar_wrapper = method(name, std::forward<LambdaT>(lambda), extra...);
+    add_vectorized_kernel<R, ArgsT...>(name, std::move(kernel_lambda));
+    return scalar_wrapper;
+  }
+
+  template<typename R, typename... Args, typename F>
+  void add_vectorized_kernel(const std::string& name, F&& f)
+  {
+    static_assert(detail::is_vectorizable<R> && (detail::is_vectorizable<Args> && ...), "method_vectorized requires argument and return types that are bits types without conversion");
+    method(name + "!", [f = std::forward<F>(f), name] (ArrayRef<remove_const_ref<Args>>... in, ArrayRef<remove_const_ref<R>> out)
+    {
+      const std::size_t n = out.size();
+      if(((in.size() != n) || ...))
+      {
+        throw std::runtime_error("Array size mismatch in vectorized call to " + name);
+      }
+      detail::vectorized_loop(f, out.data(), n, static_cast<const remove_const_ref<Args>*>(in.data())...);
+    });
   }
 
   template<typename R, typename... Args>
   FunctionWrapperBase& method_helper(const std::string& name,  std::function<R(Args...)> f, detail::ExtraFunctionData&& extraData)
   {
-    auto* new_wrapper = new FunctionWrapper<R, Args...>(this, f);
+    return register_function(m_arena.create<FunctionWrapper<R, Args...>>(this, f), name, std::move(extraData));
+  }
+
+  /// Set the name, docstring and argument data on a newly created wrapper and add it to the function list
+  FunctionWrapperBase& register_function(FunctionWrapperBase* new_wrapper, const std::string& name, detail::ExtraFunctionData&& extraData)
+  {
     new_wrapper->set_name((jl_value_t*)jl_symbol(name.c_str()));
-    new_wrapper->set_doc(jl_cstr_to_string(extraData.doc.c_str()));
+    new_wrapper->set_doc(extraData.doc);
     new_wrapper->set_extra_argument_data(std::move(extraData.positionalArguments), std::move(extraData.keywordArguments));
-    append_function(new_wrapper);
+    append_arena_function(new_wrapper);
     return *new_wrapper;
   }
 
+  /// Add a function allocated in m_arena, which owns it
+  void append_arena_function(FunctionWrapperBase* f)
+  {
+    assert(f != nullptr);
+    m_functions.push_back(f);
+    if(m_override_module != nullptr)
+    {
+      f->set_override_module(m_override_module);
+    }
+  }
+
   void set_constant(const std::string& name, jl_value_t* boxed_const);
   jl_value_t *get_constant(const std::string &name);
 
   jl_module_t* m_jl_mod;
   jl_module_t* m_override_module = nullptr;
-  std::vector<std::shared_ptr<FunctionWrapperBase>> m_functions;
+  detail::ObjectArena m_arena;
+  // Functions added through the public append_function, the others live in m_arena
+  std::vector<std::unique_ptr<FunctionWrapperBase>> m_owned_functions;
+  std::vector<FunctionWrapperBase*> m_functions;
   std::map<std::string, size_t> m_jl_constants;
   std::vector<std::string> m_constant_names;
   Array<jl_value_t*> m_constant_values;
   std::vector<jl_datatype_t*> m_box_types;
+  bool m_lazy_export = false;
+  std::size_t m_nb_exported_functions = 0;
+  const void* m_library_address = nullptr;
+  std::vector<std::vector<FunctionWrapperBase*>> m_function_groups;
+  std::unordered_multimap<uintptr_t, std::size_t> m_function_group_index;
+  std::size_t m_nb_grouped_functions = 0;
 
   template<class T> friend class TypeWrapper;
+  friend class FunctionWrapperBase;
 };
 
 template<typename T>
@@ -1027,6 +1725,27 @@ namespace detail
     (create_parameter_type<N, ParametersT,Indices>(), ...);
   }
 
+  /// Instantiation of a parametric type, postponed by TypeWrapper::apply_combination_deferred until the type is first requested
+  struct DeferredType
+  {
+    // Generic types, to find the instantiation requested from Julia
+    jl_datatype_t* dt;
+    jl_datatype_t* box_dt;
+    // Module in which the generic type was added, used if no module is being registered when the type is requested
+    Module* module;
+    // Julia parameters of the applied type, only computed when looking up a type requested from Julia
+    std::function<jl_svec_t*()> parameters;
+    std::function<void(Module&)> apply;
+    bool applied = false;
+  };
+
+  JLCXX_API void add_deferred_type(const type_hash_t& hash, DeferredType&& deferred);
+
+  /// Find the deferred instantiation matching a concrete Julia type (box type or not), returns nullptr if there is none
+  JLCXX_API std::shared_ptr<DeferredType> find_deferred_type(jl_datatype_t* applied_dt);
+
+  /// Create the type and add its methods to the module that deferred it
+  JLCXX_API void apply_deferred_type(DeferredType& deferred);
 }
 
 template<typename T>
@@ -1086,12 +1805,12 @@ public:
     return *this;
   }
 
-  /// Define a member function
+  /// Define a member function. The pointer version shares the function pointer and thunk of the reference version
   template<typename R, typename CT, typename... ArgsT, typename... Extra>
   TypeWrapper<T>& method(const std::string& name, R(CT::*f)(ArgsT...), Extra... extra)
   {
-    m_module.method(name, [f](T& obj, ArgsT... args) -> R { return (obj.*f)(args...); }, extra... );
-    m_module.method(name, [f](T* obj, ArgsT... args) -> R { return ((*obj).*f)(args...); }, extra... );
+    FunctionWrapperBase& ref_wrapper = m_module.method(name, [f](T& obj, ArgsT... args) -> R { return (obj.*f)(args...); }, extra... );
+    add_alias<R, T*, ArgsT...>(name, ref_wrapper, extra...);
     return *this;
   }
 
@@ -1099,11 +1818,20 @@ public:
   template<typename R, typename CT, typename... ArgsT, typename... Extra>
   TypeWrapper<T>& method(const std::string& name, R(CT::*f)(ArgsT...) const, Extra... extra)
   {
-    m_module.method(name, [f](const T& obj, ArgsT... args) -> R { return (obj.*f)(args...); }, extra... );
-    m_module.method(name, [f](const T* obj, ArgsT... args) -> R { return ((*obj).*f)(args...); }, extra... );
+    FunctionWrapperBase& ref_wrapper = m_module.method(name, [f](const T& obj, ArgsT... args) -> R { return (obj.*f)(args...); }, extra... );
+    add_alias<R, const T*, ArgsT...>(name, ref_wrapper, extra...);
     return *this;
   }
 
+  /// Define a member function that is known at compile time, e.g. method<&Foo::bar>("bar").
+  /// The member pointer is a template argument, so the trampoline calls it directly and nothing needs to be stored
+  template<auto MemberF, typename... Extra>
+  TypeWrapper<T>& method(const std::string& name, Extra... extra)
+  {
+    static_assert(std::is_member_function_pointer<decltype(MemberF)>::value, "Template argument to method must be a member function pointer");
+    return static_member_method<MemberF>(name, MemberF, extra...);
+  }
+
   /// Define a "member" function using a lambda
   template<typename LambdaT, typename... Extra,
            std::enable_if_t<detail::has_call_operator<LambdaT>::value && !std::is_member_function_pointer<LambdaT>::value, bool> = true>
@@ -1156,6 +1884,14 @@ public:
   template<typename ApplyT, typename... TypeLists, typename FunctorT>
   void apply_combination(FunctorT&& ftor);
 
+  /// Like apply_combination, but each combination is only applied when its type is first requested from C++ (e.g. as argument type of a function)
+  /// or from Julia (see instantiate_deferred_type in the C interface). The functor is copied and may run after the module was registered.
+  template<template<typename...> class TemplateT, typename... TypeLists, typename FunctorT>
+  void apply_combination_deferred(FunctorT&& ftor);
+
+  template<typename ApplyT, typename... TypeLists, typename FunctorT>
+  void apply_combination_deferred(FunctorT&& ftor);
+
   // Access to the module
   Module& module()
   {
@@ -1169,6 +1905,57 @@ public:
 
 private:
 
+  template<auto MemberF, typename R, typename CT, typename... ArgsT, bool NoExcept, typename... Extra>
+  TypeWrapper<T>& static_member_method(const std::string& name, R(CT::*)(ArgsT...) noexcept(NoExcept), Extra... extra)
+  {
+    FunctionWrapperBase& ref_wrapper = m_module.method(name, [](T& obj, ArgsT... args) noexcept(NoExcept) -> R { return (obj.*MemberF)(args...); }, extra... );
+    add_alias<R, T*, ArgsT...>(name, ref_wrapper, extra...);
+    return *this;
+  }
+
+  template<auto MemberF, typename R, typename CT, typename... ArgsT, bool NoExcept, typename... Extra>
+  TypeWrapper<T>& static_member_method(const std::string& name, R(CT::*)(ArgsT...) const noexcept(NoExcept), Extra... extra)
+  {
+    FunctionWrapperBase& ref_wrapper = m_module.method(name, [](const T& obj, ArgsT... args) noexcept(NoExcept) -> R { return (obj.*MemberF)(args...); }, extra... );
+    add_alias<R, const T*, ArgsT...>(name, ref_wrapper, extra...);
+    return *this;
+  }
+
+  /// Register target again under the signature R(ArgsT...), which must have the same ccall types
+  template<typename R, typename... ArgsT, typename... Extra>
+  void add_alias(const std::string& name, FunctionWrapperBase& target, Extra... extra)
+  {
+    m_module.register_function(m_module.m_arena.create<FunctionAliasWrapper<R, ArgsT...>>(&m_module, target), name, detail::parse_attributes(extra...));
+  }
+
+  template<typename AppliedT, typename FunctorT>
+  void defer_apply(const FunctorT& apply_ftor)
+  {
+    if(has_julia_type<AppliedT>())
+    {
+      FunctorT ftor_copy(apply_ftor);
+      apply<AppliedT>(ftor_copy);
+      return;
+    }
+
+    detail::DeferredType deferred;
+    deferred.dt = m_dt;
+    deferred.box_dt = m_box_dt;
+    deferred.module = &m_module;
+    deferred.parameters = [] ()
+    {
+      static constexpr int nb_julia_parameters = parameter_list<T>::nb_parameters;
+      static constexpr int nb_cpp_parameters = parameter_list<AppliedT>::nb_parameters;
+      detail::create_parameter_types<nb_julia_parameters>(parameter_list<AppliedT>(), std::make_index_sequence<nb_cpp_parameters>());
+      return parameter_list<AppliedT>()(nb_julia_parameters);
+    };
+    deferred.apply = [dt = m_dt, box_dt = m_box_dt, ftor = FunctorT(apply_ftor)] (Module& mod) mutable
+    {
+      TypeWrapper<T>(mod, dt, box_dt).template apply<AppliedT>(ftor);
+    };
+    detail::add_deferred_type(type_hash<AppliedT>(), std::move(deferred));
+  }
+
   template<typename AppliedT, typename FunctorT>
   int apply_internal(FunctorT&& apply_ftor)
   {
@@ -1176,6 +1963,7 @@ private:
     static constexpr int nb_cpp_parameters = parameter_list<AppliedT>::nb_parameters;
     static_assert(nb_cpp_parameters != 0, "No parameters found when applying type. Specialize jlcxx::BuildParameterList for your combination of type and non-type parameters.");
     static_assert(nb_cpp_parameters >= nb_julia_parameters, "Parametric type applied to wrong number of parameters.");
+    detail::RegistrationPhase phase("apply", typeid(AppliedT).name());
     const bool is_abstract = jl_is_abstracttype(m_dt);
 
     detail::create_parameter_types<nb_julia_parameters>(parameter_list<AppliedT>(), std::make_index_sequence<nb_cpp_parameters>());
@@ -1226,6 +2014,26 @@ void TypeWrapper<T>::apply_combination(FunctorT&& ftor)
   detail::DoApply<applied_list>()(*this, std::forward<FunctorT>(ftor));
 }
 
+template<typename T>
+template<template<typename...> class TemplateT, typename... TypeLists, typename FunctorT>
+void TypeWrapper<T>::apply_combination_deferred(FunctorT&& ftor)
+{
+  this->template apply_combination_deferred<ApplyType<TemplateT>, TypeLists...>(std::forward<FunctorT>(ftor));
+}
+
+template<typename T>
+template<typename ApplyT, typename... TypeLists, typename FunctorT>
+void TypeWrapper<T>::apply_combination_deferred(FunctorT&& ftor)
+{
+  static_assert(detail::IsParametric<T>::value, "Apply can only be called on parametric types");
+  typedef typename CombineTypes<ApplyT, TypeLists...>::type applied_list;
+  const std::decay_t<FunctorT> stored_ftor(std::forward<FunctorT>(ftor));
+  for_each_type<applied_list>([&] <typename AppliedT> ()
+  {
+    this->template defer_apply<AppliedT>(stored_ftor);
+  });
+}
+
 template<typename T, typename SuperParametersT, typename JLSuperT>
 TypeWrapper<T> Module::add_type_internal(const std::string& name, JLSuperT* super_generic)
 {
@@ -1233,6 +2041,7 @@ TypeWrapper<T> Module::add_type_internal(const std::string& name, JLSuperT* supe
   static_assert(!IsMirroredType<T>::value, "Mirrored types (marked with IsMirroredType) can't be added using add_type, map them directly to a struct instead and use map_type or explicitly disable mirroring for this type, e.g. define template<> struct IsMirroredType<Foo> : std::false_type { };");
   static_assert(!std::is_scalar<T>::value, "Scalar types must be added using add_bits");
 
+  detail::RegistrationPhase phase("add_type", name.c_str());
   if(get_constant(name) != nullptr)
   {
     throw std::runtime_error("Duplicate registration of type or constant " + name);
@@ -1274,12 +2083,12 @@ TypeWrapper<T> Module::add_type_internal(const std::string& name, JLSuperT* supe
 
   // Create the datatypes
   jl_datatype_t* base_dt = new_datatype(jl_symbol(name.c_str()), m_jl_mod, super, parameters, jl_emptysvec, jl_emptysvec, 1, 0, 0);
-  protect_from_gc(base_dt);
+  protect_from_gc_permanently(base_dt);
 
   super = is_parametric ? (jl_datatype_t*)apply_type((jl_value_t*)base_dt, parameters) : base_dt;
 
   jl_datatype_t* box_dt = new_datatype(jl_symbol(allocname.c_str()), m_jl_mod, super, parameters, fnames, ftypes, 0, 1, 1);
-  protect_from_gc(box_dt);
+  protect_from_gc_permanently(box_dt);
 
   // Register the type
   if(is_parametric)
@@ -1346,7 +2155,7 @@ void Module::add_bits(const std::string& name, JLSuperT* super)
   jl_svec_t* params = is_parametric ? parameter_list<T>()() : jl_emptysvec;
   JL_GC_PUSH1(&params);
   jl_datatype_t* dt = new_bitstype(jl_symbol(name.c_str()), m_jl_mod, (jl_datatype_t*)super, params, 8*sizeof(T));
-  protect_from_gc(dt);
+  protect_from_gc_permanently(dt);
   JL_GC_POP();
   detail::dispatch_set_julia_type<T, is_parametric>()(dt);
   set_const(name, (jl_value_t*)dt);
@@ -1378,6 +2187,8 @@ public:
   bool has_current_module() { return m_current_module != nullptr; }
   Module& current_module();
   void reset_current_module() { m_current_module = nullptr; }
+  /// Make types created outside of module registration add their methods to mod
+  void set_current_module(Module& mod) { m_current_module = &mod; }
 
 private:
   std::map<jl_module_t*, std::shared_ptr<Module>> m_modules;
@@ -1386,6 +2197,23 @@ private:
 
 JLCXX_API ModuleRegistry& registry();
 
+namespace detail
+{
+  /// Make a module current for the lifetime of the guard, e.g. to add types outside of module registration. Restores the previous current module, if any.
+  class JLCXX_API CurrentModuleGuard
+  {
+  public:
+    CurrentModuleGuard(Module& mod);
+    ~CurrentModuleGuard();
+
+    CurrentModuleGuard(const CurrentModuleGuard&) = delete;
+    CurrentModuleGuard& operator=(const CurrentModuleGuard&) = delete;
+
+  private:
+    Module* m_previous_module;
+  };
+}
+
 JLCXX_API void register_core_types();
 JLCXX_API void register_core_cxxwrap_types();
 /// Initialize Julia and the CxxWrap module, optionally taking a path to an environment to load
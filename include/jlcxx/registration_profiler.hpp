@@ -0,0 +1,83 @@
+#ifndef JLCXX_REGISTRATION_PROFILER_HPP
+#define JLCXX_REGISTRATION_PROFILER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "jlcxx_config.hpp"
+
+// This header provides an opt-in profiler for the phases of module registration (adding types and methods, creating types on demand, ...)
+
+namespace jlcxx
+{
+
+/// Enable or disable the registration profiler. It is initially enabled if the JLCXX_REGISTRATION_PROFILE environment variable is set.
+JLCXX_API void set_registration_profile_enabled(const bool enabled);
+JLCXX_API bool registration_profile_enabled();
+
+/// Measurements accumulated for all occurrences of a phase with the same label, e.g. the add_type phase for type Foo
+struct RegistrationProfileEntry
+{
+  std::string phase;
+  std::string label;
+  uint64_t count = 0;
+  /// Wall time, including the nested phases
+  uint64_t total_ns = 0;
+  /// Wall time, excluding the nested phases
+  uint64_t self_ns = 0;
+  /// Bytes allocated by Julia, including the nested phases
+  int64_t julia_bytes = 0;
+};
+
+/// The entries recorded since the last reset, in order of first occurrence
+JLCXX_API std::vector<RegistrationProfileEntry> registration_profile();
+
+JLCXX_API void reset_registration_profile();
+
+/// Human-readable table of the entries, sorted by decreasing self time
+JLCXX_API std::string registration_profile_report();
+
+namespace detail
+{
+  /// Discard the open phases, which are left behind when a Julia error unwinds the registration without running destructors
+  JLCXX_API void reset_registration_phases();
+
+  /// Records the enclosing scope as a phase, if the profiler is enabled. Registration happens on a single thread, and so does the recording.
+  class JLCXX_API RegistrationPhase
+  {
+  public:
+    /// The label is only copied when the profiler is enabled. C++ type names are demangled.
+    RegistrationPhase(const char* phase, const char* label) : m_active(registration_profile_enabled())
+    {
+      if(m_active)
+      {
+        start(phase, label);
+      }
+    }
+
+    ~RegistrationPhase()
+    {
+      if(m_active)
+      {
+        stop();
+      }
+    }
+
+    RegistrationPhase(const RegistrationPhase&) = delete;
+    RegistrationPhase& operator=(const RegistrationPhase&) = delete;
+
+  private:
+    void start(const char* phase, const char* label);
+    void stop();
+
+    bool m_active;
+    // Position in the stack of open phases, to detect phases that were discarded or left open
+    std::size_t m_depth = 0;
+  };
+}
+
+}
+
+#endif
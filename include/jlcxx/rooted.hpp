@@ -0,0 +1,189 @@
+#ifndef JLCXX_ROOTED_HPP
+#define JLCXX_ROOTED_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "jlcxx_config.hpp"
+#include "julia_headers.hpp"
+
+// This header provides handles keeping Julia values alive from C++, as an alternative to pairing protect_from_gc and unprotect_from_gc,
+// and diagnostics of the values kept alive
+
+namespace jlcxx
+{
+
+namespace detail
+{
+  /// Take a slot in the GC root table. The slot is scanned by the GC until it is released, and its address doesn't change.
+  JLCXX_API jl_value_t** acquire_root_slot();
+  /// Take n slots at once, appending them to slots
+  JLCXX_API void acquire_root_slots(std::vector<jl_value_t**>& slots, const std::size_t n);
+  JLCXX_API void release_root_slot(jl_value_t** slot);
+  JLCXX_API void release_root_slots(const std::vector<jl_value_t**>& slots);
+
+  /// The root scanner reads the slots while holding the root table lock, but the owner writes them without it
+  inline void store_root_slot(jl_value_t** slot, jl_value_t* value)
+  {
+    std::atomic_ref<jl_value_t*>(*slot).store(value, std::memory_order_relaxed);
+  }
+}
+
+/// Owns a slot in the GC root table, keeping the value stored in it alive. Movable but not copyable.
+/// Setting or reading the value doesn't look anything up, so a handle can be reused for different values.
+/// Like any C++ object, a handle must not be set by one thread while another thread uses it.
+template<typename T = jl_value_t>
+class Rooted
+{
+public:
+  Rooted() = default;
+
+  explicit Rooted(T* value) : m_slot(detail::acquire_root_slot())
+  {
+    detail::store_root_slot(m_slot, reinterpret_cast<jl_value_t*>(value));
+  }
+
+  Rooted(Rooted&& other) noexcept : m_slot(other.m_slot)
+  {
+    other.m_slot = nullptr;
+  }
+
+  Rooted& operator=(Rooted&& other) noexcept
+  {
+    if(this != &other)
+    {
+      reset();
+      m_slot = other.m_slot;
+      other.m_slot = nullptr;
+    }
+    return *this;
+  }
+
+  Rooted(const Rooted&) = delete;
+  Rooted& operator=(const Rooted&) = delete;
+
+  ~Rooted()
+  {
+    reset();
+  }
+
+  T* get() const
+  {
+    return m_slot == nullptr ? nullptr : reinterpret_cast<T*>(*m_slot);
+  }
+
+  operator T*() const
+  {
+    return get();
+  }
+
+  /// Root a new value, reusing the slot if there is one
+  void set(T* value)
+  {
+    if(m_slot == nullptr)
+    {
+      m_slot = detail::acquire_root_slot();
+    }
+    detail::store_root_slot(m_slot, reinterpret_cast<jl_value_t*>(value));
+  }
+
+  /// Release the slot, after which the value is no longer rooted
+  void reset()
+  {
+    if(m_slot != nullptr)
+    {
+      detail::release_root_slot(m_slot);
+      m_slot = nullptr;
+    }
+  }
+
+private:
+  jl_value_t** m_slot = nullptr;
+};
+
+/// A value protected with protect_from_gc
+struct GCRootEntry
+{
+  jl_value_t* value = nullptr;
+  /// Number of protect_from_gc calls not matched by unprotect_from_gc yet
+  std::size_t count = 0;
+  /// True if the value was first protected after the last gc_roots_checkpoint
+  bool added_since_checkpoint = false;
+};
+
+/// The values protected with protect_from_gc that have the same Julia type
+struct GCRootTypeEntry
+{
+  std::string type_name;
+  std::size_t nb_objects = 0;
+  std::size_t nb_protects = 0;
+  std::size_t nb_added_since_checkpoint = 0;
+};
+
+struct GCRootStats
+{
+  /// Values protected with protect_from_gc
+  std::size_t nb_protected = 0;
+  std::size_t nb_added_since_checkpoint = 0;
+  /// Slots in use by Rooted handles and RootScopes
+  std::size_t nb_rooted_slots = 0;
+  /// Values protected with protect_from_gc_permanently
+  std::size_t nb_permanent = 0;
+  /// Calls of cxx_root_scanner, i.e. garbage collections, and the time spent in it
+  uint64_t nb_scans = 0;
+  uint64_t total_scan_ns = 0;
+  uint64_t max_scan_ns = 0;
+  uint64_t last_scan_ns = 0;
+};
+
+/// The values protected with protect_from_gc. They may be unprotected by other threads while the result is used.
+JLCXX_API std::vector<GCRootEntry> gc_root_entries();
+
+/// The protected values grouped by Julia type, by decreasing number of objects
+JLCXX_API std::vector<GCRootTypeEntry> gc_root_types();
+
+JLCXX_API GCRootStats gc_root_stats();
+
+/// Values protected after this call are reported as added since the checkpoint, to find values that are never unprotected
+JLCXX_API void gc_roots_checkpoint();
+
+/// Human-readable table of the protected values per type, followed by the totals and root scan times
+JLCXX_API std::string gc_root_report();
+
+/// Roots the values passed to root() until the end of the scope. Slots are taken from the root table in batches,
+/// so rooting many values only takes the table lock once per batch.
+class JLCXX_API RootScope
+{
+public:
+  RootScope() = default;
+  ~RootScope();
+
+  RootScope(const RootScope&) = delete;
+  RootScope& operator=(const RootScope&) = delete;
+
+  template<typename T>
+  T* root(T* value)
+  {
+    if(m_nb_used == m_slots.size())
+    {
+      detail::acquire_root_slots(m_slots, batch_size);
+    }
+    detail::store_root_slot(m_slots[m_nb_used++], reinterpret_cast<jl_value_t*>(value));
+    return value;
+  }
+
+  std::size_t size() const { return m_nb_used; }
+
+private:
+  static constexpr std::size_t batch_size = 32;
+
+  std::vector<jl_value_t**> m_slots;
+  std::size_t m_nb_used = 0;
+};
+
+}
+
+#endif
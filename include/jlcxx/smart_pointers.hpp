@@ -264,25 +264,36 @@ struct get_pointee<PtrT<T, OtherParamsT...>>
 
 }
 
+namespace smartptr
+{
+
+/// Create the Julia types of the non-const smart pointer PtrT and its const version, with their methods.
+/// Not inline, so it can be instantiated once in a library (see stl.hpp)
+template<typename PtrT>
+void apply_smart_pointer_type(Module& curmod)
+{
+  using PointeeT = typename jlcxx::detail::get_pointee<PtrT>::pointee_t;
+  using ConstMappedT = typename jlcxx::detail::get_pointee<PtrT>::const_pointer_t;
+  create_if_not_exists<PointeeT>();
+  if constexpr(!std::is_same<supertype<PointeeT>, PointeeT>::value)
+  {
+    create_if_not_exists<typename ConvertToBase<PtrT>::SuperPtrT>();
+  }
+  assert(!has_julia_type<PtrT>());
+  jlcxx::detail::apply_smart_ptr_type<PtrT>()(curmod);
+  jlcxx::detail::apply_smart_ptr_type<ConstMappedT>()(curmod);
+  detail::SmartPtrMethods<PtrT, typename ConstructorPointerType<PtrT>::type>::apply(curmod);
+}
+
+}
+
 template<typename T>
 struct julia_type_factory<T, CxxWrappedTrait<SmartPointerTrait>>
 {
   static inline jl_datatype_t* julia_type()
   {
-    using PointeeT = typename detail::get_pointee<T>::pointee_t;
-    using ConstMappedT = typename detail::get_pointee<T>::const_pointer_t;
-    using NonConstMappedT = typename detail::get_pointee<T>::pointer_t;
-    create_if_not_exists<PointeeT>();
-    if constexpr(!std::is_same<supertype<PointeeT>, PointeeT>::value)
-    {
-      create_if_not_exists<typename smartptr::ConvertToBase<NonConstMappedT>::SuperPtrT>();
-    }
-    assert(!has_julia_type<NonConstMappedT>());
     assert(registry().has_current_module());
-    Module& curmod = registry().current_module();
-    detail::apply_smart_ptr_type<NonConstMappedT>()(curmod);
-    detail::apply_smart_ptr_type<ConstMappedT>()(curmod);
-    smartptr::detail::SmartPtrMethods<NonConstMappedT, typename ConstructorPointerType<NonConstMappedT>::type>::apply(curmod);
+    smartptr::apply_smart_pointer_type<typename detail::get_pointee<T>::pointer_t>(registry().current_module());
     assert(has_julia_type<T>());
     return JuliaTypeCache<T>::julia_type();
   }
@@ -1,6 +1,7 @@
 #ifndef JLCXX_STL_HPP
 #define JLCXX_STL_HPP
 
+#include <map>
 #include <valarray>
 #include <vector>
 #include <deque>
@@ -44,6 +45,8 @@ private:
   StlWrappers(Module& mod);
   static std::unique_ptr<StlWrappers> m_instance;
   Module& m_stl_mod;
+  // Functions creating the containers of each element type, in lazy mode
+  std::map<jl_datatype_t*, void(*)()> m_lazy_element_types;
 public:
   // TypeWrapper<Parametric<TypeVar<1>, TypeVar<2>>> iterator;
   TypeWrapper1 vector;
@@ -55,10 +58,23 @@ public:
   static void instantiate(Module& mod);
   static StlWrappers& instance();
 
+  /// True if the containers of the types in stltypes are created on first use instead of in instantiate.
+  /// Enabled by setting the JLCXX_LAZY_STL environment variable.
+  static bool lazy();
+
+  /// Create the containers and smart pointers for the stltypes element type with the given Julia type, in the STL module.
+  /// Returns false if the type is not in stltypes.
+  bool instantiate_element_type(jl_datatype_t* element_type);
+
   inline jl_module_t* module() const
   {
     return m_stl_mod.julia_module();
   }
+
+  inline Module& stl_module() const
+  {
+    return m_stl_mod;
+  }
 };
 
 JLCXX_API StlWrappers& wrappers();
@@ -275,8 +291,9 @@ struct WrapQueue
   }
 };
 
+/// Create the containers of T. Not inline, so the instantiations for the types in stltypes are only compiled in cxxwrap_julia_stl
 template<typename T>
-inline void apply_stl(jlcxx::Module& mod)
+void apply_stl(jlcxx::Module& mod)
 {
   TypeWrapper1(mod, StlWrappers::instance().vector).apply<std::vector<T>>(WrapVector());
   TypeWrapper1(mod, StlWrappers::instance().valarray).apply<std::valarray<T>>(WrapValArray());
@@ -286,26 +303,53 @@ inline void apply_stl(jlcxx::Module& mod)
   TypeWrapper1(mod, StlWrappers::instance().queue).apply<std::queue<T>>(WrapQueue());
 }
 
-}
-
-template<typename T>
-struct julia_type_factory<std::vector<T>>
+/// Creates all STL containers of the element type the first time one of them is requested
+template<typename ContainerT>
+struct StlContainerFactory
 {
-  using MappedT = std::vector<T>;
-
   static inline jl_datatype_t* julia_type()
   {
+    using T = typename ContainerT::value_type;
     create_if_not_exists<T>();
-    assert(!has_julia_type<MappedT>());
+    assert(!has_julia_type<ContainerT>());
     assert(registry().has_current_module());
-    jl_datatype_t* jltype = ::jlcxx::julia_type<T>();
-    Module& curmod = registry().current_module();
-    stl::apply_stl<T>(curmod);
-    assert(has_julia_type<MappedT>());
-    return JuliaTypeCache<MappedT>::julia_type();
+    apply_stl<T>(registry().current_module());
+    assert(has_julia_type<ContainerT>());
+    return JuliaTypeCache<ContainerT>::julia_type();
   }
 };
 
 }
 
+template<typename T>
+struct julia_type_factory<std::vector<T>> : stl::StlContainerFactory<std::vector<T>> {};
+
+template<typename T>
+struct julia_type_factory<std::valarray<T>> : stl::StlContainerFactory<std::valarray<T>> {};
+
+template<typename T>
+struct julia_type_factory<std::deque<T>> : stl::StlContainerFactory<std::deque<T>> {};
+
+template<typename T>
+struct julia_type_factory<std::queue<T>> : stl::StlContainerFactory<std::queue<T>> {};
+
+/// Calls X(T) for each element type in stltypes. The fixed size integers are aliases of the fundamental ones, so they are not listed.
+#define JLCXX_FOR_EACH_STL_TYPE(X) \
+  X(bool) X(double) X(float) X(char) X(wchar_t) X(void*) X(std::string) X(std::wstring) X(jl_value_t*) \
+  X(signed char) X(unsigned char) X(short int) X(unsigned short int) X(int) X(unsigned int) \
+  X(long) X(unsigned long) X(long long int) X(unsigned long long int)
+
+/// Explicit instantiations of the container and smart pointer wrappers for T, declared extern here and defined in stl.cpp
+#define JLCXX_STL_INSTANTIATIONS(EXTERN, T) \
+  EXTERN template JLCXX_API void stl::apply_stl<T>(Module&); \
+  EXTERN template JLCXX_API void smartptr::apply_smart_pointer_type<std::shared_ptr<T>>(Module&); \
+  EXTERN template JLCXX_API void smartptr::apply_smart_pointer_type<std::weak_ptr<T>>(Module&); \
+  EXTERN template JLCXX_API void smartptr::apply_smart_pointer_type<std::unique_ptr<T>>(Module&);
+
+#define JLCXX_EXTERN_STL_INSTANTIATIONS(T) JLCXX_STL_INSTANTIATIONS(extern, T)
+JLCXX_FOR_EACH_STL_TYPE(JLCXX_EXTERN_STL_INSTANTIATIONS)
+#undef JLCXX_EXTERN_STL_INSTANTIATIONS
+
+}
+
 #endif
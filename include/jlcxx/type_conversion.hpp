@@ -16,6 +16,8 @@
 #include <iostream>
 
 #include "jlcxx_config.hpp"
+#include "registration_profiler.hpp"
+#include "rooted.hpp"
 
 namespace jlcxx
 {
@@ -59,6 +61,9 @@ namespace detail
 
 JLCXX_API void protect_from_gc(jl_value_t* v);
 JLCXX_API void unprotect_from_gc(jl_value_t* v);
+/// Root v for the rest of the process, e.g. for types and names owned by wrapped modules. Cheaper for the GC than protect_from_gc.
+/// Rooting the same value again has no effect. Must be called from a Julia thread.
+JLCXX_API void protect_from_gc_permanently(jl_value_t* v);
 JLCXX_API void cxx_root_scanner(int);
 
 template<typename T>
@@ -73,6 +78,12 @@ inline void unprotect_from_gc(T* x)
   unprotect_from_gc((jl_value_t*)x);
 }
 
+template<typename T>
+inline void protect_from_gc_permanently(T* x)
+{
+  protect_from_gc_permanently((jl_value_t*)x);
+}
+
 /// Get the symbol name correctly depending on Julia version
 inline std::string symbol_name(jl_sym_t* symbol)
 {
@@ -92,10 +103,50 @@ JLCXX_API jl_value_t* apply_type(jl_value_t* tc, jl_value_t **params, size_t n);
 JLCXX_API jl_datatype_t* apply_type(jl_value_t* tc, jl_datatype_t *type);
 
 
-/// Get the type from a global symbol
+/// Get the type from a global symbol. Results are cached per module being registered, until CxxWrap binds new constants or clear_julia_type_cache is called.
 JLCXX_API jl_value_t* julia_type(const std::string& name, const std::string& module_name = "");
 JLCXX_API jl_value_t* julia_type(const std::string& name, jl_module_t* mod);
 
+/// Forget the results of julia_type(name, module_name), e.g. after defining a global that shadows a type found before
+JLCXX_API void clear_julia_type_cache();
+
+/// One of the core types, or null if it was not found. Converting a missing type throws, so it is only an error when a binding uses it.
+struct CoreType
+{
+  const char* name = nullptr;
+  jl_value_t* value = nullptr;
+
+  jl_value_t* get() const
+  {
+    if(value == nullptr)
+    {
+      throw std::runtime_error(std::string("Type ") + name + " was not found, check that the CxxWrap version matches libcxxwrap-julia");
+    }
+    return value;
+  }
+
+  operator jl_value_t*() const { return get(); }
+};
+
+/// Generic types used by the type factories, looked up once instead of by name on each use
+struct CoreTypes
+{
+  CoreType cxx_ref{"CxxRef"};
+  CoreType const_cxx_ref{"ConstCxxRef"};
+  CoreType cxx_ptr{"CxxPtr"};
+  CoreType const_cxx_ptr{"ConstCxxPtr"};
+  CoreType cxx_const{"CxxConst"};
+  CoreType safe_cfunction{"SafeCFunction"};
+  CoreType strictly_typed_number{"StrictlyTypedNumber"};
+  CoreType const_array{"ConstArray"};
+  CoreType val{"Val"};
+  CoreType complex{"Complex"};
+  CoreType ptr{"Ptr"};
+};
+
+/// The types are looked up on first use, throwing if CxxWrap is not initialized yet. A missing type only throws when it is used.
+JLCXX_API const CoreTypes& core_types();
+
 /// Backwards-compatible apply_array_type
 template<typename T>
 inline jl_value_t* apply_array_type(T* type, std::size_t dim)
@@ -176,6 +227,16 @@ struct BoxedValue
   jl_value_t* value;
 };
 
+/// Indicate if passing or returning a T gives access to objects managed by Julia. Such types can't be used in functions marked jlcxx::gc_safe
+template<typename T> struct IsJuliaObjectType : std::false_type {};
+template<> struct IsJuliaObjectType<jl_value_t*> : std::true_type {};
+template<> struct IsJuliaObjectType<jl_datatype_t*> : std::true_type {};
+template<> struct IsJuliaObjectType<jl_array_t*> : std::true_type {};
+template<> struct IsJuliaObjectType<jl_module_t*> : std::true_type {};
+template<> struct IsJuliaObjectType<jl_sym_t*> : std::true_type {};
+template<> struct IsJuliaObjectType<jl_svec_t*> : std::true_type {};
+template<typename T> struct IsJuliaObjectType<BoxedValue<T>> : std::true_type {};
+
 template<typename CppT>
 inline CppT* extract_pointer(const WrappedCppPtr& p)
 {
@@ -335,7 +396,7 @@ struct CachedDatatype
     m_dt = dt;
     if(m_dt != nullptr && protect)
     {
-      protect_from_gc(m_dt);
+      protect_from_gc_permanently(m_dt);
     }
   }
 
@@ -456,6 +517,13 @@ void set_julia_type(jl_datatype_t* dt, bool protect = true)
   JuliaTypeCache<typename std::remove_const<T>::type>::set_julia_type(dt, protect);
 }
 
+namespace detail
+{
+  /// Create the type with the given hash if its instantiation was deferred using TypeWrapper::apply_combination_deferred.
+  /// Returns false if there is no such deferred type.
+  JLCXX_API bool apply_deferred_type(const type_hash_t& hash);
+}
+
 /// Store the Julia datatype linked to SourceT
 template<typename SourceT, typename TraitT=mapping_trait<SourceT>>
 class julia_type_factory
@@ -463,6 +531,10 @@ class julia_type_factory
 public:
   static inline jl_datatype_t* julia_type()
   {
+    if(detail::apply_deferred_type(type_hash<SourceT>()))
+    {
+      return JuliaTypeCache<SourceT>::julia_type();
+    }
     throw std::runtime_error(std::string("No appropriate factory for type ") + typeid(SourceT).name());
     return nullptr;
   }
@@ -506,6 +578,7 @@ void create_if_not_exists()
   {
     if(!has_julia_type<nonconst_t>())
     {
+      detail::RegistrationPhase phase("create_type", typeid(nonconst_t).name());
       create_julia_type<nonconst_t>();
     }
     exists = true;
@@ -548,7 +621,7 @@ struct julia_type_factory<const SourceT&>
 {
   static inline jl_datatype_t* julia_type()
   {
-    return apply_type(jlcxx::julia_type("ConstCxxRef"), julia_base_type<SourceT>());
+    return apply_type(core_types().const_cxx_ref, julia_base_type<SourceT>());
   }
 };
 
@@ -558,7 +631,7 @@ struct julia_type_factory<SourceT&>
 {
   static inline jl_datatype_t* julia_type()
   {
-    return apply_type(jlcxx::julia_type("CxxRef"), julia_base_type<SourceT>());
+    return apply_type(core_types().cxx_ref, julia_base_type<SourceT>());
   }
 };
 
@@ -568,7 +641,7 @@ struct julia_type_factory<const SourceT*>
 {
   static inline jl_datatype_t* julia_type()
   {
-    return apply_type(jlcxx::julia_type("ConstCxxPtr"), julia_base_type<SourceT>());
+    return apply_type(core_types().const_cxx_ptr, julia_base_type<SourceT>());
   }
 };
 
@@ -578,7 +651,7 @@ struct julia_type_factory<SourceT*>
 {
   static inline jl_datatype_t* julia_type()
   {
-    return apply_type(jlcxx::julia_type("CxxPtr"), julia_base_type<SourceT>());
+    return apply_type(core_types().cxx_ptr, julia_base_type<SourceT>());
   }
 };
 
@@ -623,7 +696,7 @@ struct ConvertToCpp
 
 /// Conversion to C++
 template<typename CppT, typename JuliaT>
-inline CppT convert_to_cpp(JuliaT julia_val)
+inline CppT convert_to_cpp(JuliaT julia_val) noexcept(noexcept(ConvertToCpp<CppT>()(julia_val)))
 {
   return ConvertToCpp<CppT>()(julia_val);
 }
@@ -726,7 +799,7 @@ struct ConvertToJulia
 template<typename T>
 struct ConvertToJulia<T&, WrappedPtrTrait>
 {
-  WrappedCppPtr operator()(T& cpp_val) const
+  WrappedCppPtr operator()(T& cpp_val) const noexcept
   {
     return {reinterpret_cast<void*>(const_cast<typename std::remove_const<T>::type*>(&cpp_val))};
   }
@@ -735,7 +808,7 @@ struct ConvertToJulia<T&, WrappedPtrTrait>
 template<typename T>
 struct ConvertToJulia<T*, WrappedPtrTrait>
 {
-  WrappedCppPtr operator()(T* cpp_val) const
+  WrappedCppPtr operator()(T* cpp_val) const noexcept
   {
     return {reinterpret_cast<void*>(const_cast<typename std::remove_const<T>::type*>(cpp_val))};
   }
@@ -744,7 +817,7 @@ struct ConvertToJulia<T*, WrappedPtrTrait>
 template<typename T>
 struct ConvertToJulia<T*, DirectPtrTrait>
 {
-  T* operator()(T* cpp_val) const
+  T* operator()(T* cpp_val) const noexcept
   {
     return cpp_val;
   }
@@ -754,7 +827,7 @@ struct ConvertToJulia<T*, DirectPtrTrait>
 template<typename T>
 struct ConvertToJulia<T, NoMappingTrait>
 {
-  T operator()(const T& cpp_val) const
+  T operator()(const T& cpp_val) const noexcept
   {
     return cpp_val;
   }
@@ -782,7 +855,7 @@ struct ConvertToJulia<std::complex<NumberT>, NoMappingTrait>
 
 /// Conversion to the statically mapped target type.
 template<typename T>
-inline auto convert_to_julia(T&& cpp_val) -> decltype(ConvertToJulia<T>()(std::forward<T>(cpp_val)))
+inline auto convert_to_julia(T&& cpp_val) noexcept(noexcept(ConvertToJulia<T>()(std::forward<T>(cpp_val)))) -> decltype(ConvertToJulia<T>()(std::forward<T>(cpp_val)))
 {
   return ConvertToJulia<T>()(std::forward<T>(cpp_val));
 }
@@ -958,7 +1031,7 @@ inline CppT unbox(jl_value_t* juliaval)
 template<typename CppT>
 struct ConvertToCpp<CppT, NoMappingTrait>
 {
-  inline CppT operator()(CppT julia_val) const
+  inline CppT operator()(CppT julia_val) const noexcept
   {
     return julia_val;
   }
@@ -968,7 +1041,7 @@ struct ConvertToCpp<CppT, NoMappingTrait>
 template<typename CppT>
 struct ConvertToCpp<CppT*, WrappedPtrTrait>
 {
-  inline CppT* operator()(WrappedCppPtr julia_val) const
+  inline CppT* operator()(WrappedCppPtr julia_val) const noexcept
   {
     return extract_pointer<CppT>(julia_val);
   }
@@ -977,7 +1050,7 @@ struct ConvertToCpp<CppT*, WrappedPtrTrait>
 template<typename CppT>
 struct ConvertToCpp<CppT*, DirectPtrTrait>
 {
-  inline CppT* operator()(CppT* julia_val) const
+  inline CppT* operator()(CppT* julia_val) const noexcept
   {
     return julia_val;
   }
@@ -1017,7 +1090,7 @@ struct TypeVar
   static jl_tvar_t* build_tvar()
   {
     jl_tvar_t* result = jl_new_typevar(jl_symbol((std::string("T") + std::to_string(I)).c_str()), (jl_value_t*)jl_bottom_type, (jl_value_t*)jl_any_type);
-    protect_from_gc(result);
+    protect_from_gc_permanently(result);
     return result;
   }
 };
@@ -1113,7 +1186,7 @@ struct julia_type_factory<Val<T, v>>
 {
   static inline jl_datatype_t* julia_type()
   {
-    return apply_type(::jlcxx::julia_type("Val", jl_base_module), (jl_datatype_t*) ::jlcxx::box<T>(v));
+    return apply_type(core_types().val, (jl_datatype_t*) ::jlcxx::box<T>(v));
   }
 };
 
@@ -1122,7 +1195,7 @@ struct julia_type_factory<Val<const std::string_view&, str>>
 {
   static inline jl_datatype_t* julia_type()
   {
-    return apply_type(::jlcxx::julia_type("Val", jl_base_module), (jl_datatype_t*) jl_symbol(str.data()));
+    return apply_type(core_types().val, (jl_datatype_t*) jl_symbol(str.data()));
   }
 };
 
@@ -1140,7 +1213,7 @@ struct ConvertToJulia<Val<T, v>, NoMappingTrait>
 {
   jl_datatype_t* operator()(Val<T, v>) const
   {
-    static jl_datatype_t* type = apply_type(::jlcxx::julia_type("Val", jl_base_module), (jl_datatype_t*) ::jlcxx::box<T>(v));
+    static jl_datatype_t* type = apply_type(core_types().val, (jl_datatype_t*) ::jlcxx::box<T>(v));
     return type;
   }
 };
@@ -1150,7 +1223,7 @@ struct ConvertToJulia<Val<const std::string_view&, str>, NoMappingTrait>
 {
   jl_datatype_t* operator()(Val<const std::string_view&, str>) const
   {
-    static jl_datatype_t* type = apply_type(::jlcxx::julia_type("Val", jl_base_module), (jl_datatype_t*) jl_symbol(str.data()));
+    static jl_datatype_t* type = apply_type(core_types().val, (jl_datatype_t*) jl_symbol(str.data()));
     return type;
   }
 };
@@ -1180,7 +1253,7 @@ template<typename NumberT> struct julia_type_factory<StrictlyTypedNumber<NumberT
 {
   static jl_datatype_t* julia_type()
   {
-    return apply_type(::jlcxx::julia_type("StrictlyTypedNumber"), ::jlcxx::julia_type<NumberT>());
+    return apply_type(core_types().strictly_typed_number, ::jlcxx::julia_type<NumberT>());
   }
 };
 
@@ -1190,7 +1263,7 @@ template<typename NumberT> struct julia_type_factory<std::complex<NumberT>>
 {
   static jl_datatype_t* julia_type()
   {
-    return apply_type(jlcxx::julia_type("Complex"), ::jlcxx::julia_type<NumberT>());
+    return apply_type(core_types().complex, ::jlcxx::julia_type<NumberT>());
   }
 };
 
@@ -0,0 +1,170 @@
+#include "jlcxx/async.hpp"
+#include "jlcxx/jlcxx.hpp"
+
+#include <algorithm>
+#include <exception>
+
+namespace jlcxx
+{
+
+ThreadPool::ThreadPool(const std::size_t nb_threads)
+{
+  m_workers.reserve(nb_threads);
+  for(std::size_t i = 0; i != nb_threads; ++i)
+  {
+    m_workers.emplace_back([this] () { run_worker(); });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_task_available.notify_all();
+  for(std::thread& worker : m_workers)
+  {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push_back(std::move(task));
+  }
+  m_task_available.notify_one();
+}
+
+void ThreadPool::run_worker()
+{
+  while(true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_task_available.wait(lock, [this] () { return m_stopping || !m_tasks.empty(); });
+      if(m_tasks.empty())
+      {
+        return;
+      }
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+    task();
+  }
+}
+
+JLCXX_API ThreadPool& async_thread_pool()
+{
+  // Never destroyed: joining the workers at exit would hang on a task that doesn't finish, so they are left running instead
+  static ThreadPool* pool = new ThreadPool(std::max(std::thread::hardware_concurrency(), 1u));
+  return *pool;
+}
+
+namespace
+{
+  using uv_async_send_t = int(*)(void*);
+
+  // libuv is part of the Julia runtime, look it up there instead of linking it
+  uv_async_send_t uv_async_send_function()
+  {
+    static const uv_async_send_t f = reinterpret_cast<uv_async_send_t>(jl_unbox_voidpointer(jl_eval_string("cglobal(:uv_async_send)")));
+    return f;
+  }
+}
+
+/// Shared between the AsyncCall and the worker, so the worker never touches the Julia object. The last of the two to finish releases it,
+/// so neither waits for the other.
+struct AsyncCall::State
+{
+  std::mutex mutex;
+  bool done = false;
+  result_boxer_t box_result;
+  std::exception_ptr exception;
+  // Rooted as long as the AsyncCall or the worker may use the uv handle. Releasing the slot doesn't call Julia, so the worker can do it.
+  Rooted<jl_value_t> condition;
+  void* uv_handle = nullptr;
+  uv_async_send_t notify = nullptr;
+};
+
+AsyncCall::AsyncCall() : m_state(std::make_shared<State>())
+{
+  m_state->condition.set(jl_call0(jl_get_function(jl_base_module, "AsyncCondition")));
+  if(m_state->condition.get() == nullptr)
+  {
+    throw std::runtime_error("Failed to create the condition for an async call");
+  }
+  m_state->uv_handle = jl_unbox_voidpointer(jl_get_field(m_state->condition, "handle"));
+  m_state->notify = uv_async_send_function();
+}
+
+AsyncCall::~AsyncCall() = default;
+
+void AsyncCall::start(task_t task)
+{
+  async_thread_pool().submit([state = m_state, task = std::move(task)] () mutable
+  {
+    result_boxer_t box_result;
+    std::exception_ptr exception;
+    try
+    {
+      box_result = task();
+    }
+    catch(...)
+    {
+      exception = std::current_exception();
+    }
+    // The arguments stored in the task are not needed anymore
+    task = nullptr;
+
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->box_result = std::move(box_result);
+      state->exception = exception;
+      state->done = true;
+      state->notify(state->uv_handle);
+    }
+    // If the AsyncCall was already finalized, this releases the condition
+    state.reset();
+  });
+}
+
+bool AsyncCall::done() const
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  return m_state->done;
+}
+
+void AsyncCall::wait()
+{
+  static jl_function_t* wait_function = jl_get_function(jl_base_module, "wait");
+  // The AsyncCondition remembers a notification that arrives before the wait
+  while(!done())
+  {
+    jl_call1(wait_function, m_state->condition);
+    if(jl_exception_occurred() != nullptr)
+    {
+      // E.g. an InterruptException, passed on to the caller of wait or fetch
+      throw JuliaError(jl_exception_occurred());
+    }
+  }
+}
+
+jl_value_t* AsyncCall::fetch()
+{
+  wait();
+  if(m_state->exception)
+  {
+    std::rethrow_exception(m_state->exception);
+  }
+  if(!m_state->box_result)
+  {
+    return jl_nothing;
+  }
+  return m_state->box_result();
+}
+
+}
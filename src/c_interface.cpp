@@ -1,6 +1,7 @@
 #include "jlcxx/array.hpp"
 #include "jlcxx/jlcxx.hpp"
 #include "jlcxx/jlcxx_config.hpp"
+#include "jlcxx/metadata_cache.hpp"
 
 #include "julia_gcext.h"
 
@@ -36,6 +37,25 @@ struct BuildEquivalence
   ArrayRef<jl_value_t*> m_equivalent_types;
 };
 
+namespace
+{
+
+/// Copy a vector of pointers to a new Julia array, allocated at its final size
+template<typename ArrayT>
+jl_array_t* to_julia_array(const ArrayT& values)
+{
+  Array<typename ArrayT::value_type> result(values.size());
+  JL_GC_PUSH1(result.gc_pointer());
+  for(std::size_t i = 0; i != values.size(); ++i)
+  {
+    result.set(i, values[i]);
+  }
+  JL_GC_POP();
+  return result.wrapped();
+}
+
+}
+
 struct GetFundamentalTypes
 {
   template<typename T>
@@ -48,6 +68,78 @@ struct GetFundamentalTypes
   ArrayRef<jl_value_t*> m_type_sizes;
 };
 
+namespace
+{
+
+/// Build the array of CppFunctionInfo for the given functions, allocating all arrays at their final size.
+/// The argument types of the functions must be resolved already, since resolving them may add functions.
+jl_array_t* make_function_infos(const std::vector<FunctionWrapperBase*>& functions)
+{
+  const std::size_t nb_functions = functions.size();
+  Array<jl_value_t*> function_array(g_cppfunctioninfo_type, nb_functions);
+  JL_GC_PUSH1(function_array.gc_pointer());
+
+  for(std::size_t i = 0; i != nb_functions; ++i)
+  {
+    FunctionWrapperBase& f = *functions[i];
+    jl_value_t* arg_types_array = nullptr;
+    jl_value_t* boxed_f = nullptr;
+    jl_value_t* boxed_thunk = nullptr;
+    jl_value_t* arg_names_array = nullptr;
+    jl_value_t* arg_default_values_array = nullptr;
+    jl_value_t* boxed_n_kwargs = nullptr;
+    JL_GC_PUSH6(&arg_types_array, &boxed_f, &boxed_thunk, &arg_names_array, &arg_default_values_array, &boxed_n_kwargs);
+
+    arg_types_array = (jl_value_t*)to_julia_array(f.argument_types());
+
+    void* fptr = f.pointer();
+    void* thunk = f.thunk();
+    if(call_statistics_enabled() && f.profiled_pointer() != nullptr)
+    {
+      f.enable_statistics();
+      fptr = f.profiled_pointer();
+      thunk = &f;
+    }
+    boxed_f = jlcxx::box<void*>(fptr);
+    boxed_thunk = jlcxx::box<void*>(thunk);
+
+    arg_names_array = (jl_value_t*)to_julia_array(f.argument_names());
+    arg_default_values_array = (jl_value_t*)to_julia_array(f.argument_default_values());
+
+    boxed_n_kwargs = jlcxx::box<int>(f.number_of_keyword_arguments());
+
+    auto returntypes = f.return_type();
+
+    jl_datatype_t* ccall_return_type = returntypes.first;
+    jl_datatype_t* julia_return_type = returntypes.second;
+    if(ccall_return_type == nullptr)
+    {
+      ccall_return_type = julia_type<void>();
+      julia_return_type = ccall_return_type;
+    }
+
+    function_array.set(i, jl_new_struct(g_cppfunctioninfo_type,
+      f.name(),
+      arg_types_array,
+      ccall_return_type,
+      julia_return_type,
+      boxed_f,
+      boxed_thunk,
+      f.override_module(),
+      f.doc(),
+      arg_names_array,
+      arg_default_values_array,
+      boxed_n_kwargs
+    ));
+
+    JL_GC_POP();
+  }
+  JL_GC_POP();
+  return function_array.wrapped();
+}
+
+}
+
 }
 
 extern "C"
@@ -80,12 +172,18 @@ JLCXX_API void register_julia_module(jl_module_t* jlmod, void (*regfunc)(jlcxx::
 {
   try
   {
+    detail::reset_registration_phases();
+    detail::RegistrationPhase phase("register_julia_module", registration_profile_enabled() ? module_name(jlmod).c_str() : "");
     jlcxx::Module& mod = jlcxx::registry().create_module(jlmod);
+    mod.set_library_address(reinterpret_cast<const void*>(regfunc));
     regfunc(mod);
-    mod.for_each_function([] (FunctionWrapperBase& f) {
-      // Make sure any pointers in the types are also resolved at module init.
-      f.argument_types();
-    });
+    if(!mod.lazy_export())
+    {
+      mod.for_each_function([] (FunctionWrapperBase& f) {
+        // Make sure any pointers in the types are also resolved at module init.
+        f.argument_types();
+      });
+    }
     jlcxx::registry().reset_current_module();
   }
   catch (const std::runtime_error& e)
@@ -112,94 +210,290 @@ JLCXX_API void bind_module_constants(jl_value_t* module_any, jl_value_t* symbols
   registry().get_module(mod).bind_constants(ArrayRef<jl_value_t*>((jl_array_t*)symbols), ArrayRef<jl_value_t*>((jl_array_t*)values));
 }
 
-void fill_types_vec(Array<jl_datatype_t*>& types_array, const std::vector<jl_datatype_t*>& types_vec)
+/// Functions starting from the 0-based index first, for exporting functions added after the module was registered
+JLCXX_API jl_array_t* get_module_functions_from(jl_module_t* jlmod, const std::size_t first)
 {
-  for(const auto& t : types_vec)
+  detail::RegistrationPhase phase("get_module_functions", registration_profile_enabled() ? module_name(jlmod).c_str() : "");
+  // Resolve all argument types first, which may add functions to the module
+  std::vector<FunctionWrapperBase*> functions;
+  jlcxx::Module& module = registry().get_module(jlmod);
+  std::size_t index = 0;
+  module.for_each_function([&](FunctionWrapperBase& f)
   {
-    types_array.push_back(t);
-  }
+    if(index++ >= first)
+    {
+      functions.push_back(&f);
+      f.argument_types();
+    }
+  });
+
+  jl_array_t* result = make_function_infos(functions);
+  module.set_nb_exported_functions(index);
+  return result;
 }
 
-void fill_values_vec(Array<jl_value_t*>& types_array, const std::vector<jl_value_t*>& types_vec)
+/// Functions added since the last export of the module, e.g. by deferred types of this module that were applied while registering another module
+JLCXX_API jl_array_t* get_unexported_module_functions(jl_module_t* jlmod)
 {
-  for(const auto& t : types_vec)
-  {
-    types_array.push_back(t);
-  }
+  return get_module_functions_from(jlmod, registry().get_module(jlmod).nb_exported_functions());
 }
 
 /// Get the functions defined in the modules. Any classes used by these functions must be defined on the Julia side first
 JLCXX_API jl_array_t* get_module_functions(jl_module_t* jlmod)
 {
-  Array<jl_value_t*> function_array(g_cppfunctioninfo_type);
-  JL_GC_PUSH1(function_array.gc_pointer());
+  return get_module_functions_from(jlmod, 0);
+}
 
-  const jlcxx::Module& module = registry().get_module(jlmod);
-  module.for_each_function([&](FunctionWrapperBase& f)
+/// Fill in the function pointer and thunk of each function, as passed in the CppFunctionInfo returned by get_module_functions, without building
+/// the rest of the function info. The arrays must have one element per function. Used by the stubs generated by jlcxx_dump_bindings.
+JLCXX_API void get_module_function_pointers(jl_module_t* jlmod, jl_value_t* pointers, jl_value_t* thunks)
+{
+  try
   {
-    Array<jl_datatype_t*> arg_types_array;
-    jl_value_t* boxed_f = nullptr;
-    jl_value_t* boxed_thunk = nullptr;
-    Array<jl_value_t*> arg_names_array;
-    Array<jl_value_t*> arg_default_values_array;
-    jl_value_t* boxed_n_kwargs;
-    JL_GC_PUSH6(arg_types_array.gc_pointer(), &boxed_f, &boxed_thunk, arg_names_array.gc_pointer(), arg_default_values_array.gc_pointer(), &boxed_n_kwargs);
+    ArrayRef<void*> pointers_array((jl_array_t*)pointers);
+    ArrayRef<void*> thunks_array((jl_array_t*)thunks);
+    // Resolve all argument types first, which may add functions to the module
+    std::vector<FunctionWrapperBase*> functions;
+    registry().get_module(jlmod).for_each_function([&](FunctionWrapperBase& f)
+    {
+      functions.push_back(&f);
+      f.argument_types();
+    });
+    if(functions.size() != pointers_array.size() || functions.size() != thunks_array.size())
+    {
+      throw std::runtime_error("Module " + module_name(jlmod) + " has " + std::to_string(functions.size()) + " functions, but " + std::to_string(pointers_array.size()) + " pointers were requested");
+    }
+    for(std::size_t i = 0; i != functions.size(); ++i)
+    {
+      FunctionWrapperBase& f = *functions[i];
+      if(call_statistics_enabled() && f.profiled_pointer() != nullptr)
+      {
+        f.enable_statistics();
+        pointers_array[i] = f.profiled_pointer();
+        thunks_array[i] = &f;
+      }
+      else
+      {
+        pointers_array[i] = f.pointer();
+        thunks_array[i] = f.thunk();
+      }
+    }
+  }
+  catch (const std::exception& e)
+  {
+    jl_error(e.what());
+  }
+}
 
-    fill_types_vec(arg_types_array, f.argument_types());
+/// Create a parametric type deferred with apply_combination_deferred the first time Julia needs it, in the module defining its generic type.
+/// Returns the number of functions that module had before, so the caller can wrap the new box type and export the functions from that index on
+/// (see get_module_functions_from), or -1 if no deferred instantiation matches the type.
+JLCXX_API cxxint_t instantiate_deferred_type(jl_datatype_t* applied_dt)
+{
+  try
+  {
+    std::shared_ptr<detail::DeferredType> deferred = detail::find_deferred_type(applied_dt);
+    if(deferred == nullptr)
+    {
+      return -1;
+    }
+    const cxxint_t nb_functions = deferred->module->num_functions();
+    detail::apply_deferred_type(*deferred);
+    return nb_functions;
+  }
+  catch(const std::exception& e)
+  {
+    jl_error(e.what());
+  }
+  return -1;
+}
 
-    boxed_f = jlcxx::box<void*>(f.pointer());
-    boxed_thunk = jlcxx::box<void*>(f.thunk());
+JLCXX_API bool is_lazy_module(jl_module_t* jlmod)
+{
+  return registry().get_module(jlmod).lazy_export();
+}
 
-    fill_values_vec(arg_names_array, f.argument_names());
-    fill_values_vec(arg_default_values_array, f.argument_default_values());
+/// For lazy modules: append the name and override module of each group of functions sharing these, counting only groups added since the
+/// previous call. Julia defines a stub for each group that calls get_module_function_group with the 0-based group index on first use.
+JLCXX_API void get_module_function_names(jl_module_t* jlmod, jl_value_t* names, jl_value_t* override_modules)
+{
+  ArrayRef<jl_value_t*> names_array((jl_array_t*)names);
+  ArrayRef<jl_value_t*> override_modules_array((jl_array_t*)override_modules);
+  jlcxx::Module& module = registry().get_module(jlmod);
+  for(std::size_t i = module.update_function_groups(); i != module.nb_function_groups(); ++i)
+  {
+    const FunctionWrapperBase& f = *module.function_group(i).front();
+    names_array.push_back(f.name());
+    override_modules_array.push_back(f.override_module());
+  }
+}
 
-    boxed_n_kwargs = jlcxx::box<int>(f.number_of_keyword_arguments());
+/// The CppFunctionInfo for each function in the given group
+JLCXX_API jl_array_t* get_module_function_group(jl_module_t* jlmod, std::size_t group_index)
+{
+  try
+  {
+    const std::vector<FunctionWrapperBase*>& functions = registry().get_module(jlmod).function_group(group_index);
+    for(FunctionWrapperBase* f : functions)
+    {
+      f->argument_types();
+    }
+    return make_function_infos(functions);
+  }
+  catch (const std::exception& e)
+  {
+    jl_error(e.what());
+  }
+  return nullptr;
+}
 
-    auto returntypes = f.return_type();
+/// Record call statistics for the functions of modules registered from now on
+JLCXX_API void enable_call_statistics(bool enabled)
+{
+  set_call_statistics_enabled(enabled);
+}
 
-    jl_datatype_t* ccall_return_type = returntypes.first;
-    jl_datatype_t* julia_return_type = returntypes.second;
-    if(ccall_return_type == nullptr)
+JLCXX_API int call_statistics_nb_buckets()
+{
+  return CallStatistics::nb_buckets;
+}
+
+/// Append the call statistics of each function in the module: names (Any), call counts and total time in ns (UInt64), and
+/// call_statistics_nb_buckets() histogram values per function (UInt64)
+JLCXX_API void get_call_statistics(jl_module_t* jlmod, jl_value_t* names, jl_value_t* nb_calls, jl_value_t* total_ns, jl_value_t* histograms)
+{
+  ArrayRef<jl_value_t*> names_array((jl_array_t*)names);
+  ArrayRef<uint64_t> nb_calls_array((jl_array_t*)nb_calls);
+  ArrayRef<uint64_t> total_ns_array((jl_array_t*)total_ns);
+  ArrayRef<uint64_t> histograms_array((jl_array_t*)histograms);
+  registry().get_module(jlmod).for_each_function([&](FunctionWrapperBase& f)
+  {
+    // Functions without statistics were registered while statistics were disabled, and report zero calls
+    static const CallStatistics no_statistics;
+    const CallStatistics& statistics = f.statistics() != nullptr ? *f.statistics() : no_statistics;
+    names_array.push_back(f.name());
+    nb_calls_array.push_back(statistics.nb_calls);
+    total_ns_array.push_back(statistics.total_ns);
+    for(const auto& count : statistics.histogram)
     {
-      ccall_return_type = julia_type<void>();
-      julia_return_type = ccall_return_type;
+      histograms_array.push_back(count);
     }
+  });
+}
 
-    function_array.push_back(jl_new_struct(g_cppfunctioninfo_type,
-      f.name(),
-      arg_types_array.wrapped(),
-      ccall_return_type,
-      julia_return_type,
-      boxed_f,
-      boxed_thunk,
-      f.override_module(),
-      f.doc(),
-      arg_names_array.wrapped(),
-      arg_default_values_array.wrapped(),
-      boxed_n_kwargs
-    ));
-
-    JL_GC_POP();
+JLCXX_API void reset_call_statistics(jl_module_t* jlmod)
+{
+  registry().get_module(jlmod).for_each_function([](FunctionWrapperBase& f)
+  {
+    if(f.statistics() != nullptr)
+    {
+      f.statistics()->reset();
+    }
   });
-  JL_GC_POP();
-  return function_array.wrapped();
 }
 
-jl_array_t* convert_type_vector(const std::vector<jl_datatype_t*> types_vec)
+JLCXX_API void enable_registration_profile(bool enabled)
+{
+  set_registration_profile_enabled(enabled);
+}
+
+/// Append an entry per registration phase and label: phase and label (Any, as strings), count, total and self time in ns (UInt64)
+/// and bytes allocated by Julia (Int64)
+JLCXX_API void get_registration_profile(jl_value_t* phases, jl_value_t* labels, jl_value_t* counts, jl_value_t* total_ns, jl_value_t* self_ns, jl_value_t* julia_bytes)
 {
-  Array<jl_datatype_t*> datatypes;
-  JL_GC_PUSH1(datatypes.gc_pointer());
-  for(jl_datatype_t* dt : types_vec)
+  ArrayRef<jl_value_t*> phases_array((jl_array_t*)phases);
+  ArrayRef<jl_value_t*> labels_array((jl_array_t*)labels);
+  ArrayRef<uint64_t> counts_array((jl_array_t*)counts);
+  ArrayRef<uint64_t> total_ns_array((jl_array_t*)total_ns);
+  ArrayRef<uint64_t> self_ns_array((jl_array_t*)self_ns);
+  ArrayRef<int64_t> julia_bytes_array((jl_array_t*)julia_bytes);
+  for(const RegistrationProfileEntry& entry : registration_profile())
   {
-    datatypes.push_back(dt);
+    phases_array.push_back(jl_cstr_to_string(entry.phase.c_str()));
+    labels_array.push_back(jl_cstr_to_string(entry.label.c_str()));
+    counts_array.push_back(entry.count);
+    total_ns_array.push_back(entry.total_ns);
+    self_ns_array.push_back(entry.self_ns);
+    julia_bytes_array.push_back(entry.julia_bytes);
+  }
+}
+
+/// The registration profile as a table, sorted by decreasing self time
+JLCXX_API jl_value_t* registration_profile_report()
+{
+  return jl_cstr_to_string(jlcxx::registration_profile_report().c_str());
+}
+
+JLCXX_API void reset_registration_profile()
+{
+  jlcxx::reset_registration_profile();
+}
+
+/// Identifies the build of the library that defined the module
+JLCXX_API jl_value_t* module_build_id(jl_module_t* jlmod)
+{
+  try
+  {
+    const void* address = registry().get_module(jlmod).library_address();
+    return jl_cstr_to_string(address == nullptr ? "" : library_build_id(address).c_str());
+  }
+  catch (const std::exception& e)
+  {
+    jl_error(e.what());
+  }
+  return nullptr;
+}
+
+/// Write the metadata of the module to the cache file at path. The file starts with the build ID of the wrapper library.
+JLCXX_API void write_module_metadata_cache(jl_module_t* jlmod, const char* path)
+{
+  try
+  {
+    write_metadata_cache(registry().get_module(jlmod), path);
+  }
+  catch (const std::exception& e)
+  {
+    jl_error(e.what());
   }
-  JL_GC_POP();
-  return datatypes.wrapped();
+}
+
+/// Check, without exporting the module, if the cache file at path was written for the same build of the wrapper library
+JLCXX_API bool module_metadata_cache_valid(jl_module_t* jlmod, const char* path)
+{
+  try
+  {
+    return metadata_cache_is_valid(registry().get_module(jlmod), path);
+  }
+  catch (const std::exception& e)
+  {
+    jl_error(e.what());
+  }
+  return false;
+}
+
+/// The metadata from the cache file at path as a String, or nothing if the cache is not valid. Used instead of get_module_functions,
+/// together with get_module_function_pointers.
+JLCXX_API jl_value_t* read_module_metadata_cache(jl_module_t* jlmod, const char* path)
+{
+  try
+  {
+    const std::optional<std::string> metadata = read_metadata_cache(registry().get_module(jlmod), path);
+    if(!metadata)
+    {
+      return jl_nothing;
+    }
+    return jl_pchar_to_string(metadata->data(), metadata->size());
+  }
+  catch (const std::exception& e)
+  {
+    jl_error(e.what());
+  }
+  return nullptr;
 }
 
 JLCXX_API jl_array_t* get_box_types(jl_module_t* jlmod)
 {
-  return convert_type_vector(registry().get_module(jlmod).box_types());
+  return to_julia_array(registry().get_module(jlmod).box_types());
 }
 
 JLCXX_API const char* cxxwrap_version_string()
@@ -217,6 +511,65 @@ JLCXX_API void gcunprotect(jl_value_t* v)
   unprotect_from_gc(v);
 }
 
+/// Append an entry per value protected with gcprotect or protect_from_gc: the value (Any), its protect count (UInt64)
+/// and 1 if it was first protected after the last gc_roots_checkpoint (UInt8)
+JLCXX_API void get_gc_roots(jl_value_t* values, jl_value_t* counts, jl_value_t* added_since_checkpoint)
+{
+  ArrayRef<jl_value_t*> values_array((jl_array_t*)values);
+  ArrayRef<uint64_t> counts_array((jl_array_t*)counts);
+  ArrayRef<uint8_t> added_array((jl_array_t*)added_since_checkpoint);
+  for(const GCRootEntry& entry : gc_root_entries())
+  {
+    values_array.push_back(entry.value);
+    counts_array.push_back(entry.count);
+    added_array.push_back(entry.added_since_checkpoint ? 1 : 0);
+  }
+}
+
+/// Append an entry per Julia type of the protected values: type name (Any, as string), number of objects, of protects
+/// and of objects added since the last checkpoint (UInt64), by decreasing number of objects
+JLCXX_API void get_gc_root_types(jl_value_t* type_names, jl_value_t* nb_objects, jl_value_t* nb_protects, jl_value_t* nb_added_since_checkpoint)
+{
+  ArrayRef<jl_value_t*> type_names_array((jl_array_t*)type_names);
+  ArrayRef<uint64_t> nb_objects_array((jl_array_t*)nb_objects);
+  ArrayRef<uint64_t> nb_protects_array((jl_array_t*)nb_protects);
+  ArrayRef<uint64_t> nb_added_array((jl_array_t*)nb_added_since_checkpoint);
+  for(const GCRootTypeEntry& entry : gc_root_types())
+  {
+    type_names_array.push_back(jl_cstr_to_string(entry.type_name.c_str()));
+    nb_objects_array.push_back(entry.nb_objects);
+    nb_protects_array.push_back(entry.nb_protects);
+    nb_added_array.push_back(entry.nb_added_since_checkpoint);
+  }
+}
+
+/// Append the totals to a UInt64 array: protected values, added since the checkpoint, Rooted slots in use, permanent roots,
+/// root scans and the total, maximum and last time spent scanning in ns
+JLCXX_API void get_gc_root_stats(jl_value_t* stats)
+{
+  ArrayRef<uint64_t> stats_array((jl_array_t*)stats);
+  const GCRootStats root_stats = gc_root_stats();
+  stats_array.push_back(root_stats.nb_protected);
+  stats_array.push_back(root_stats.nb_added_since_checkpoint);
+  stats_array.push_back(root_stats.nb_rooted_slots);
+  stats_array.push_back(root_stats.nb_permanent);
+  stats_array.push_back(root_stats.nb_scans);
+  stats_array.push_back(root_stats.total_scan_ns);
+  stats_array.push_back(root_stats.max_scan_ns);
+  stats_array.push_back(root_stats.last_scan_ns);
+}
+
+JLCXX_API void gc_roots_checkpoint()
+{
+  jlcxx::gc_roots_checkpoint();
+}
+
+/// The protected values per type and the totals, as a table
+JLCXX_API jl_value_t* gc_root_report()
+{
+  return jl_cstr_to_string(jlcxx::gc_root_report().c_str());
+}
+
 JLCXX_API void get_integer_types(jl_value_t* all_fundamental_types, jl_value_t* type_sizes, jl_value_t* fundamental_types_matched, jl_value_t* equivalent_types)
 {
   for_each_type<fundamental_int_types>(GetFundamentalTypes{ArrayRef<jl_value_t*>((jl_array_t*)all_fundamental_types), ArrayRef<jl_value_t*>((jl_array_t*)type_sizes)});
@@ -5,14 +5,465 @@
 
 #include <julia_gcext.h>
 
+#ifdef __GNUG__
+  #include <cxxabi.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <typeindex>
+#include <unordered_map>
+#include <unordered_set>
+
 namespace jlcxx
 {
 
-using cxx_gc_roots_t = std::map<jl_value_t*, int>;
-cxx_gc_roots_t& cxx_gc_roots()
+namespace
+{
+
+/// Values protected from GC, with the number of times each one is protected. Open addressing with linear probing and
+/// backward shift deletion, so protect and unprotect are O(1) and the root scanner reads a single contiguous array.
+class GCRootTable
+{
+public:
+  /// Null is used for empty slots, and doesn't need protection anyway
+  void protect(jl_value_t* v)
+  {
+    if(v == nullptr)
+    {
+      return;
+    }
+    if(2*(m_size+1) > m_slots.size())
+    {
+      rehash(std::max(2*m_slots.size(), min_capacity));
+    }
+    const std::size_t i = find(v);
+    Slot& slot = m_slots[i];
+    if(slot.value == nullptr)
+    {
+      slot.value = v;
+      m_sequences[i] = m_next_sequence++;
+      ++m_size;
+    }
+    ++slot.count;
+  }
+
+  void unprotect(jl_value_t* v)
+  {
+    if(v == nullptr)
+    {
+      return;
+    }
+    const std::size_t i = m_slots.empty() ? 0 : find(v);
+    if(m_slots.empty() || m_slots[i].value == nullptr)
+    {
+      throw std::runtime_error("Attempt to unprotect an object that was not GC protected");
+    }
+    if(--m_slots[i].count == 0)
+    {
+      erase(i);
+      if(m_slots.size() > min_capacity && 8*m_size < m_slots.size())
+      {
+        rehash(m_slots.size() / 2);
+      }
+    }
+  }
+
+  template<typename FunctorT>
+  void for_each_root(FunctorT&& f) const
+  {
+    for(const Slot& slot : m_slots)
+    {
+      if(slot.value != nullptr)
+      {
+        f(slot.value);
+      }
+    }
+  }
+
+  /// Values protected from sequence number first_new on are reported as added since the checkpoint
+  void entries(std::vector<GCRootEntry>& result, const uint64_t first_new) const
+  {
+    result.reserve(result.size() + m_size);
+    for(std::size_t i = 0; i != m_slots.size(); ++i)
+    {
+      if(m_slots[i].value != nullptr)
+      {
+        result.push_back(GCRootEntry { m_slots[i].value, static_cast<std::size_t>(m_slots[i].count), m_sequences[i] >= first_new });
+      }
+    }
+  }
+
+  /// Number of values protected from sequence number first_new on
+  std::size_t nb_added_since(const uint64_t first_new) const
+  {
+    std::size_t result = 0;
+    for(std::size_t i = 0; i != m_slots.size(); ++i)
+    {
+      if(m_slots[i].value != nullptr && m_sequences[i] >= first_new)
+      {
+        ++result;
+      }
+    }
+    return result;
+  }
+
+  std::size_t size() const
+  {
+    return m_size;
+  }
+
+  /// Sequence number of the next value that gets protected
+  uint64_t next_sequence() const
+  {
+    return m_next_sequence;
+  }
+
+private:
+  struct Slot
+  {
+    jl_value_t* value = nullptr;
+    int count = 0;
+  };
+  static_assert(sizeof(Slot) <= 2*sizeof(void*), "Slots are read by the root scanner, keep them small");
+
+  static constexpr std::size_t min_capacity = 64;
+
+  std::size_t home(jl_value_t* v) const
+  {
+    // Fibonacci hashing, the low bits of pointers are always zero
+    return static_cast<std::size_t>((reinterpret_cast<uint64_t>(v) * 0x9E3779B97F4A7C15ull) >> 32) & (m_slots.size() - 1);
+  }
+
+  /// Index of the slot containing v, or of the empty slot where it would be inserted
+  std::size_t find(jl_value_t* v) const
+  {
+    const std::size_t mask = m_slots.size() - 1;
+    std::size_t i = home(v);
+    while(m_slots[i].value != nullptr && m_slots[i].value != v)
+    {
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  /// Move the following entries of the probe sequence back into the hole, so lookups never need tombstones
+  void erase(std::size_t hole)
+  {
+    const std::size_t mask = m_slots.size() - 1;
+    for(std::size_t i = (hole + 1) & mask; m_slots[i].value != nullptr; i = (i + 1) & mask)
+    {
+      const std::size_t i_home = home(m_slots[i].value);
+      if(((i - i_home) & mask) >= ((i - hole) & mask))
+      {
+        m_slots[hole] = m_slots[i];
+        m_sequences[hole] = m_sequences[i];
+        hole = i;
+      }
+    }
+    m_slots[hole] = Slot();
+    m_sequences[hole] = 0;
+    --m_size;
+  }
+
+  void rehash(const std::size_t capacity)
+  {
+    std::vector<Slot> old_slots(capacity);
+    std::vector<uint64_t> old_sequences(capacity);
+    old_slots.swap(m_slots);
+    old_sequences.swap(m_sequences);
+    for(std::size_t i = 0; i != old_slots.size(); ++i)
+    {
+      if(old_slots[i].value != nullptr)
+      {
+        const std::size_t j = find(old_slots[i].value);
+        m_slots[j] = old_slots[i];
+        m_sequences[j] = old_sequences[i];
+      }
+    }
+  }
+
+  std::vector<Slot> m_slots;
+  // Order in which the value in the slot with the same index was protected, for the checkpoints of the diagnostics.
+  // Separate from the slots, so it doesn't slow down the root scanner.
+  std::vector<uint64_t> m_sequences;
+  std::size_t m_size = 0;
+  uint64_t m_next_sequence = 0;
+};
+
+/// Protects done by one thread and not yet added to the root table
+struct StagedRoots
+{
+  std::mutex mutex;
+  std::vector<jl_value_t*> values;
+};
+
+/// Thread-safe roots: protects are appended to a buffer of the calling thread, so they only take the lock of that buffer,
+/// which is uncontended. An unprotect of a value still in the buffer of the calling thread removes it from there. Otherwise
+/// the buffers are merged into the table first, as when one is full and before each root scan, which take the table lock.
+/// Protects only add to counts, so merging them in any order gives the same table.
+class GCRoots
 {
-  static cxx_gc_roots_t m_roots;
-  return m_roots;
+public:
+  void protect(jl_value_t* v)
+  {
+    if(v == nullptr)
+    {
+      return;
+    }
+    StagedRoots& staged = thread_staged_roots();
+    bool full = false;
+    {
+      std::lock_guard<std::mutex> lock(staged.mutex);
+      staged.values.push_back(v);
+      full = staged.values.size() >= max_staged;
+    }
+    if(full)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      merge(staged);
+    }
+  }
+
+  void unprotect(jl_value_t* v)
+  {
+    if(v == nullptr)
+    {
+      return;
+    }
+    // Protect and unprotect from the same thread cancel out in the buffer, without taking the table lock
+    {
+      StagedRoots& staged = thread_staged_roots();
+      std::lock_guard<std::mutex> lock(staged.mutex);
+      const auto found = std::find(staged.values.rbegin(), staged.values.rend(), v);
+      if(found != staged.values.rend())
+      {
+        staged.values.erase(std::next(found).base());
+        return;
+      }
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // A protect of v in another thread that happened before this call is in some buffer
+    merge_all();
+    m_table.unprotect(v);
+  }
+
+  void acquire_slots(std::vector<jl_value_t**>& slots, const std::size_t n)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(std::size_t i = 0; i != n; ++i)
+    {
+      if(m_free_slots.empty())
+      {
+        // Chunks never move, so the slots stay valid while others are added
+        m_slot_chunks.emplace_back(new jl_value_t*[slot_chunk_size]());
+        for(std::size_t j = slot_chunk_size; j != 0; --j)
+        {
+          m_free_slots.push_back(&m_slot_chunks.back()[j-1]);
+        }
+      }
+      slots.push_back(m_free_slots.back());
+      m_free_slots.pop_back();
+    }
+  }
+
+  void release_slots(jl_value_t** const* slots, const std::size_t n)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(std::size_t i = 0; i != n; ++i)
+    {
+      detail::store_root_slot(slots[i], nullptr);
+      m_free_slots.push_back(slots[i]);
+    }
+  }
+
+  template<typename FunctorT>
+  void for_each_root(FunctorT&& f)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    merge_all();
+    m_table.for_each_root(f);
+    for(const std::unique_ptr<jl_value_t*[]>& chunk : m_slot_chunks)
+    {
+      for(std::size_t i = 0; i != slot_chunk_size; ++i)
+      {
+        // Written by their owners without the lock, see detail::store_root_slot
+        jl_value_t* v = std::atomic_ref<jl_value_t*>(chunk[i]).load(std::memory_order_relaxed);
+        if(v != nullptr)
+        {
+          f(v);
+        }
+      }
+    }
+  }
+
+  std::vector<GCRootEntry> entries()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    merge_all();
+    std::vector<GCRootEntry> result;
+    m_table.entries(result, m_checkpoint);
+    return result;
+  }
+
+  void checkpoint()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    merge_all();
+    m_checkpoint = m_table.next_sequence();
+  }
+
+  /// Fills the number of protected values, new values and slots in use
+  void stats(GCRootStats& result)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    merge_all();
+    result.nb_protected = m_table.size();
+    result.nb_added_since_checkpoint = m_table.nb_added_since(m_checkpoint);
+    result.nb_rooted_slots = m_slot_chunks.size()*slot_chunk_size - m_free_slots.size();
+  }
+
+private:
+  static constexpr std::size_t max_staged = 1024;
+  static constexpr std::size_t slot_chunk_size = 1024;
+
+  /// Registers the buffer of the thread on first use, and merges it into the table when the thread exits
+  struct ThreadStagedRoots
+  {
+    ThreadStagedRoots(GCRoots& roots) : m_roots(roots)
+    {
+      std::lock_guard<std::mutex> lock(m_roots.m_mutex);
+      m_roots.m_staged.push_back(&m_staged);
+    }
+
+    ~ThreadStagedRoots()
+    {
+      std::lock_guard<std::mutex> lock(m_roots.m_mutex);
+      m_roots.merge(m_staged);
+      m_roots.m_staged.erase(std::find(m_roots.m_staged.begin(), m_roots.m_staged.end(), &m_staged));
+    }
+
+    GCRoots& m_roots;
+    StagedRoots m_staged;
+  };
+
+  StagedRoots& thread_staged_roots()
+  {
+    thread_local ThreadStagedRoots m_thread_roots(*this);
+    return m_thread_roots.m_staged;
+  }
+
+  /// Lock order is the table lock, then a buffer lock. Must be called with the table lock held.
+  void merge(StagedRoots& staged)
+  {
+    std::lock_guard<std::mutex> lock(staged.mutex);
+    for(jl_value_t* v : staged.values)
+    {
+      m_table.protect(v);
+    }
+    staged.values.clear();
+  }
+
+  void merge_all()
+  {
+    for(StagedRoots* staged : m_staged)
+    {
+      merge(*staged);
+    }
+  }
+
+  std::mutex m_mutex;
+  GCRootTable m_table;
+  std::vector<StagedRoots*> m_staged;
+  // Slots owned by Rooted handles and RootScopes, free slots are null
+  std::vector<std::unique_ptr<jl_value_t*[]>> m_slot_chunks;
+  std::vector<jl_value_t**> m_free_slots;
+  uint64_t m_checkpoint = 0;
+};
+
+/// Values rooted for the rest of the process, in a Julia array so the root scanner only marks the array.
+/// Once the array is old, the elements are not traced again by young collections. Each value is added once.
+/// Adding allocates Julia memory, so it must be done from a Julia thread.
+class PermanentRoots
+{
+public:
+  void add(jl_value_t* v)
+  {
+    if(v == nullptr)
+    {
+      return;
+    }
+    JL_GC_PUSH1(&v);
+    std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+    {
+      // Pushing may trigger a GC, which waits for all threads to reach a safepoint, so threads waiting for the lock must not block it
+      detail::GCSafeRegion gc_safe;
+      lock.lock();
+    }
+    if(m_values.insert(v).second)
+    {
+      if(m_array == nullptr)
+      {
+        m_array = jl_alloc_array_1d(jl_array_any_type, 0);
+      }
+      jl_array_ptr_1d_push(m_array, v);
+      ++m_size;
+    }
+    lock.unlock();
+    JL_GC_POP();
+  }
+
+  /// Read by the root scanner without the lock: during a GC, a thread adding a root is stopped with the array in a consistent state
+  jl_array_t* array() const
+  {
+    return m_array;
+  }
+
+  std::size_t size() const
+  {
+    return m_size;
+  }
+
+private:
+  std::mutex m_mutex;
+  jl_array_t* m_array = nullptr;
+  // Values in the array, which are never collected, so their addresses are not reused
+  std::unordered_set<jl_value_t*> m_values;
+  std::atomic<std::size_t> m_size = 0;
+};
+
+/// Time spent in cxx_root_scanner, updated by the thread running the GC
+struct RootScanTimes
+{
+  std::atomic<uint64_t> nb_scans = 0;
+  std::atomic<uint64_t> total_ns = 0;
+  std::atomic<uint64_t> max_ns = 0;
+  std::atomic<uint64_t> last_ns = 0;
+};
+
+RootScanTimes& root_scan_times()
+{
+  static RootScanTimes m_times;
+  return m_times;
+}
+
+PermanentRoots& permanent_roots()
+{
+  static PermanentRoots* m_roots = new PermanentRoots();
+  return *m_roots;
+}
+
+GCRoots& cxx_gc_roots()
+{
+  // Never destroyed, since threads may still exit and merge their buffers during static destruction
+  static GCRoots* m_roots = new GCRoots();
+  return *m_roots;
+}
+
 }
 
 jl_module_t* g_cxxwrap_module = nullptr;
@@ -20,39 +471,316 @@ jl_datatype_t* g_cppfunctioninfo_type = nullptr;
 
 JLCXX_API void protect_from_gc(jl_value_t* v)
 {
-  // Insert a "number of times protected" count of 1 or increment the count
-  auto insresult = cxx_gc_roots().insert(std::make_pair(v, 1));
-  if(!insresult.second)
+  cxx_gc_roots().protect(v);
+}
+
+JLCXX_API void unprotect_from_gc(jl_value_t* v)
+{
+  cxx_gc_roots().unprotect(v);
+}
+
+JLCXX_API void protect_from_gc_permanently(jl_value_t* v)
+{
+  permanent_roots().add(v);
+}
+
+namespace detail
+{
+
+JLCXX_API jl_value_t** acquire_root_slot()
+{
+  std::vector<jl_value_t**> slots;
+  cxx_gc_roots().acquire_slots(slots, 1);
+  return slots.front();
+}
+
+JLCXX_API void acquire_root_slots(std::vector<jl_value_t**>& slots, const std::size_t n)
+{
+  cxx_gc_roots().acquire_slots(slots, n);
+}
+
+JLCXX_API void release_root_slot(jl_value_t** slot)
+{
+  cxx_gc_roots().release_slots(&slot, 1);
+}
+
+JLCXX_API void release_root_slots(const std::vector<jl_value_t**>& slots)
+{
+  cxx_gc_roots().release_slots(slots.data(), slots.size());
+}
+
+}
+
+RootScope::~RootScope()
+{
+  detail::release_root_slots(m_slots);
+}
+
+JLCXX_API void cxx_root_scanner(int)
+{
+#if (JULIA_VERSION_MAJOR * 100 + JULIA_VERSION_MINOR) >= 107
+  jl_ptls_t ptls = jl_current_task->ptls;
+#else
+  jl_ptls_t ptls = jl_get_ptls_states();
+#endif
+  const auto start = std::chrono::steady_clock::now();
+  jl_array_t* permanent = permanent_roots().array();
+  if(permanent != nullptr)
   {
-    ++(insresult.first->second);
+    jl_gc_mark_queue_obj(ptls, (jl_value_t*)permanent);
+  }
+  cxx_gc_roots().for_each_root([ptls] (jl_value_t* v) { jl_gc_mark_queue_obj(ptls, v); });
+
+  const uint64_t elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  RootScanTimes& times = root_scan_times();
+  times.nb_scans += 1;
+  times.total_ns += elapsed_ns;
+  times.last_ns = elapsed_ns;
+  if(elapsed_ns > times.max_ns)
+  {
+    times.max_ns = elapsed_ns;
   }
 }
 
-JLCXX_API void unprotect_from_gc(jl_value_t* v)
+JLCXX_API std::vector<GCRootEntry> gc_root_entries()
+{
+  return cxx_gc_roots().entries();
+}
+
+JLCXX_API std::vector<GCRootTypeEntry> gc_root_types()
 {
-  auto it = cxx_gc_roots().find(v);
-  if(it == cxx_gc_roots().end())
+  std::vector<GCRootTypeEntry> result;
+  std::unordered_map<jl_value_t*, std::size_t> type_index;
+  for(const GCRootEntry& entry : gc_root_entries())
   {
-    throw std::runtime_error("Attempt to unprotect an object that was not GC protected");
+    jl_value_t* type = jl_typeof(entry.value);
+    auto it = type_index.find(type);
+    if(it == type_index.end())
+    {
+      it = type_index.emplace(type, result.size()).first;
+      GCRootTypeEntry type_entry;
+      type_entry.type_name = julia_type_name(type);
+      result.push_back(std::move(type_entry));
+    }
+    GCRootTypeEntry& type_entry = result[it->second];
+    type_entry.nb_objects += 1;
+    type_entry.nb_protects += entry.count;
+    type_entry.nb_added_since_checkpoint += entry.added_since_checkpoint ? 1 : 0;
   }
-  --(it->second);
-  if(it->second == 0)
+  std::stable_sort(result.begin(), result.end(), [] (const GCRootTypeEntry& a, const GCRootTypeEntry& b) { return a.nb_objects > b.nb_objects; });
+  return result;
+}
+
+JLCXX_API GCRootStats gc_root_stats()
+{
+  GCRootStats result;
+  cxx_gc_roots().stats(result);
+  result.nb_permanent = permanent_roots().size();
+  const RootScanTimes& times = root_scan_times();
+  result.nb_scans = times.nb_scans;
+  result.total_scan_ns = times.total_ns;
+  result.max_scan_ns = times.max_ns;
+  result.last_scan_ns = times.last_ns;
+  return result;
+}
+
+JLCXX_API void gc_roots_checkpoint()
+{
+  cxx_gc_roots().checkpoint();
+}
+
+JLCXX_API std::string gc_root_report()
+{
+  const GCRootStats stats = gc_root_stats();
+  std::stringstream report;
+  report << std::setw(10) << "objects" << std::setw(12) << "protects" << std::setw(10) << "new" << "  type\n";
+  for(const GCRootTypeEntry& entry : gc_root_types())
   {
-    cxx_gc_roots().erase(it);
+    report << std::setw(10) << entry.nb_objects << std::setw(12) << entry.nb_protects << std::setw(10) << entry.nb_added_since_checkpoint << "  " << entry.type_name << "\n";
   }
+  report << "protected: " << stats.nb_protected << " (" << stats.nb_added_since_checkpoint << " new), rooted slots: " << stats.nb_rooted_slots
+    << ", permanent: " << stats.nb_permanent << "\n";
+  report << std::fixed << std::setprecision(3) << "root scans: " << stats.nb_scans << ", mean " << (stats.nb_scans == 0 ? 0.0 : stats.total_scan_ns * 1e-6 / stats.nb_scans)
+    << " ms, max " << stats.max_scan_ns * 1e-6 << " ms, last " << stats.last_scan_ns * 1e-6 << " ms\n";
+  return report.str();
 }
 
-JLCXX_API void cxx_root_scanner(int)
+std::atomic<bool>& call_statistics_flag()
 {
-#if (JULIA_VERSION_MAJOR * 100 + JULIA_VERSION_MINOR) >= 107
-  jl_ptls_t ptls = jl_current_task->ptls;
+  static std::atomic<bool> m_enabled(std::getenv("JLCXX_CALL_STATISTICS") != nullptr);
+  return m_enabled;
+}
+
+JLCXX_API void set_call_statistics_enabled(const bool enabled)
+{
+  call_statistics_flag() = enabled;
+}
+
+JLCXX_API bool call_statistics_enabled()
+{
+  return call_statistics_flag();
+}
+
+namespace
+{
+
+struct ExceptionTranslator
+{
+  exception_translator_t translate;
+  // Null for translators that decide for themselves if they apply
+  bool (*matches)();
+};
+
+using translator_list_t = std::vector<ExceptionTranslator>;
+using translator_indices_t = std::vector<std::size_t>;
+
+/// The list is replaced on registration, so translating only copies a pointer under the lock
+struct ExceptionTranslators
+{
+  std::mutex mutex;
+  std::shared_ptr<const translator_list_t> translators = std::make_shared<translator_list_t>();
+  // Per thrown type, the indices of the translators that may apply
+  std::unordered_map<std::type_index, std::shared_ptr<const translator_indices_t>> applicable;
+};
+
+ExceptionTranslators& exception_translators()
+{
+  static ExceptionTranslators m_translators;
+  return m_translators;
+}
+
+/// Type of the exception currently being handled, or null if the ABI doesn't provide it
+const std::type_info* current_exception_type()
+{
+#ifdef __GNUG__
+  return abi::__cxa_current_exception_type();
 #else
-  jl_ptls_t ptls = jl_get_ptls_states();
+  return nullptr;
 #endif
-  for(const auto rootpair : cxx_gc_roots())
+}
+
+void add_exception_translator(ExceptionTranslator translator)
+{
+  ExceptionTranslators& translators = exception_translators();
+  std::lock_guard<std::mutex> lock(translators.mutex);
+  auto new_list = std::make_shared<translator_list_t>(*translators.translators);
+  // A module registering its exceptions on each load replaces the translators it added before, instead of growing the list
+  if(translator.matches != nullptr)
   {
-    jl_gc_mark_queue_obj(ptls, rootpair.first);
+    std::erase_if(*new_list, [&] (const ExceptionTranslator& existing) { return existing.matches == translator.matches; });
   }
+  new_list->push_back(std::move(translator));
+  translators.translators = std::move(new_list);
+  translators.applicable.clear();
+}
+
+}
+
+JLCXX_API void register_exception_translator(exception_translator_t translator)
+{
+  add_exception_translator(ExceptionTranslator { std::move(translator), nullptr });
+}
+
+JLCXX_API void register_exception_translator(bool (*matches)(), exception_translator_t translator)
+{
+  add_exception_translator(ExceptionTranslator { std::move(translator), matches });
+}
+
+JLCXX_API jl_value_t* current_exception_to_julia()
+{
+  // Julia exceptions passed through C++ take precedence over the translators, which may handle std::exception
+  const std::type_info* thrown_type = current_exception_type();
+  if(thrown_type == nullptr || *thrown_type == typeid(JuliaError))
+  {
+    try
+    {
+      throw;
+    }
+    catch(const JuliaError& e)
+    {
+      return e.julia_exception();
+    }
+    catch(...)
+    {
+    }
+  }
+
+  ExceptionTranslators& translators = exception_translators();
+  std::shared_ptr<const translator_list_t> list;
+  std::shared_ptr<const translator_indices_t> applicable;
+  {
+    std::lock_guard<std::mutex> lock(translators.mutex);
+    list = translators.translators;
+    if(thrown_type != nullptr)
+    {
+      auto it = translators.applicable.find(std::type_index(*thrown_type));
+      if(it != translators.applicable.end())
+      {
+        applicable = it->second;
+      }
+    }
+  }
+
+  if(thrown_type != nullptr && applicable == nullptr)
+  {
+    // First exception of this type: test the translators, rethrowing once per translator with a matches function
+    auto indices = std::make_shared<translator_indices_t>();
+    for(std::size_t i = 0; i != list->size(); ++i)
+    {
+      if((*list)[i].matches == nullptr || (*list)[i].matches())
+      {
+        indices->push_back(i);
+      }
+    }
+    applicable = indices;
+    std::lock_guard<std::mutex> lock(translators.mutex);
+    if(translators.translators == list)
+    {
+      translators.applicable.emplace(std::type_index(*thrown_type), applicable);
+    }
+  }
+
+  for(std::size_t n = applicable != nullptr ? applicable->size() : list->size(); n != 0; --n)
+  {
+    const ExceptionTranslator& translator = (*list)[applicable != nullptr ? (*applicable)[n-1] : n-1];
+    if(applicable == nullptr && translator.matches != nullptr && !translator.matches())
+    {
+      continue;
+    }
+    // A throwing translator must not escape to the wrapped function's caller, the exception then gets the generic message
+    jl_value_t* julia_exception = nullptr;
+    try
+    {
+      julia_exception = translator.translate();
+    }
+    catch(...)
+    {
+      break;
+    }
+    if(julia_exception != nullptr)
+    {
+      return julia_exception;
+    }
+  }
+
+  jl_value_t* msg = nullptr;
+  jl_value_t* result = nullptr;
+  JL_GC_PUSH1(&msg);
+  try
+  {
+    throw;
+  }
+  catch(const std::exception& err)
+  {
+    msg = jl_cstr_to_string(err.what());
+  }
+  catch(...)
+  {
+    msg = jl_cstr_to_string("Unknown C++ exception");
+  }
+  result = jl_new_struct(jl_errorexception_type, msg);
+  JL_GC_POP();
+  return result;
 }
 
 JLCXX_API std::stack<std::size_t>& gc_free_stack()
@@ -65,11 +793,13 @@ Module::Module(jl_module_t* jmod) :
   m_jl_mod(jmod),
   m_constant_values(jl_any_type)
 {
-  protect_from_gc(m_constant_values.wrapped());
+  protect_from_gc_permanently(m_constant_values.wrapped());
 }
 
 void Module::bind_constants(ArrayRef<jl_value_t*> symbols, ArrayRef<jl_value_t*> values)
 {
+  // The constants become Julia globals, which may shadow names found by julia_type before
+  clear_julia_type_cache();
   const std::size_t nb_consts = m_jl_constants.size();
   assert(nb_consts == jl_array_len(m_constant_values.wrapped()));
   assert(nb_consts == m_constant_names.size());
@@ -99,11 +829,151 @@ jl_value_t* Module::get_constant(const std::string& name)
   return jl_array_ptr_ref(m_constant_values.wrapped(), it->second);
 }
 
+std::size_t Module::update_function_groups()
+{
+  const std::size_t first_new_group = m_function_groups.size();
+  for(; m_nb_grouped_functions != m_functions.size(); ++m_nb_grouped_functions)
+  {
+    FunctionWrapperBase* f = m_functions[m_nb_grouped_functions];
+    // Constructor names are structs, so compare by value
+    const uintptr_t key = jl_object_id(f->name()) ^ reinterpret_cast<uintptr_t>(f->override_module());
+    const auto range = m_function_group_index.equal_range(key);
+    auto it = range.first;
+    for(; it != range.second; ++it)
+    {
+      const FunctionWrapperBase* group_front = m_function_groups[it->second].front();
+      if(jl_egal(group_front->name(), f->name()) && group_front->override_module() == f->override_module())
+      {
+        m_function_groups[it->second].push_back(f);
+        break;
+      }
+    }
+    if(it == range.second)
+    {
+      m_function_group_index.emplace(key, m_function_groups.size());
+      m_function_groups.push_back({f});
+    }
+  }
+  return first_new_group;
+}
+
 FunctionWrapperBase::FunctionWrapperBase(Module* mod, std::pair<jl_datatype_t*,jl_datatype_t*> return_type) :
   m_name(nullptr), m_module(mod), m_return_type(return_type), m_override_module((jl_value_t*)mod->julia_module())
 {
 }
 
+void FunctionWrapperBase::set_doc(const std::string& doc)
+{
+  if(doc.empty())
+  {
+    m_doc = detail::interned_string("");
+    return;
+  }
+  set_doc(jl_cstr_to_string(doc.c_str()));
+}
+
+void FunctionWrapperBase::enable_statistics()
+{
+  if(m_statistics == nullptr)
+  {
+    m_statistics = std::make_unique<CallStatistics>();
+  }
+}
+
+std::span<jl_datatype_t* const> FunctionWrapperBase::argument_types() const
+{
+  if(!m_argument_types_resolved)
+  {
+    m_argument_types = m_module->m_arena.copy_array(resolve_argument_types());
+    m_argument_types_resolved = true;
+  }
+  return m_argument_types;
+}
+
+void FunctionWrapperBase::set_extra_argument_data(std::vector<arg>&& posArgs, std::vector<kwarg>&& kwArgs)
+{
+  m_number_of_keyword_args = kwArgs.size();
+
+  // gather all argument names and default values, copying them to the arena once complete
+  std::vector<jl_value_t*> argument_names;
+  std::vector<jl_value_t*> argument_default_values;
+  argument_names.reserve(posArgs.size() + kwArgs.size());
+  argument_default_values.reserve(posArgs.size() + kwArgs.size());
+  for(auto& a: posArgs)
+  {
+    argument_names.push_back(detail::interned_string(a.name));
+    argument_default_values.push_back(a.defaultValue);
+  }
+  for(auto& a: kwArgs)
+  {
+    argument_names.push_back(detail::interned_string(a.name));
+    argument_default_values.push_back(a.defaultValue);
+  }
+  m_argument_names = m_module->m_arena.copy_array(argument_names);
+  m_argument_default_values = m_module->m_arena.copy_array(argument_default_values);
+}
+
+namespace detail
+{
+
+JLCXX_API jl_value_t* interned_string(const char* str)
+{
+  static std::mutex m_mutex;
+  static std::unordered_map<std::string, jl_value_t*> m_strings;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_strings.find(str);
+    if(it != m_strings.end())
+    {
+      return it->second;
+    }
+  }
+
+  // Allocate without holding the lock, since this may run the GC. If another thread inserted the same string meanwhile, its result is used.
+  jl_value_t* result = jl_cstr_to_string(str);
+  JL_GC_PUSH1(&result);
+  bool inserted = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto insresult = m_strings.emplace(str, result);
+    inserted = insresult.second;
+    result = insresult.first->second;
+  }
+  if(inserted)
+  {
+    protect_from_gc_permanently(result);
+  }
+  JL_GC_POP();
+  return result;
+}
+
+ObjectArena::~ObjectArena()
+{
+  for(auto it = m_destructors.rbegin(); it != m_destructors.rend(); ++it)
+  {
+    it->second(it->first);
+  }
+}
+
+void* ObjectArena::allocate(const std::size_t size, const std::size_t alignment)
+{
+  void* result = std::align(alignment, size, m_free, m_free_size);
+  if(result == nullptr)
+  {
+    const std::size_t new_block_size = std::max(block_size, size + alignment);
+    m_blocks.emplace_back(new char[new_block_size]);
+    m_free = m_blocks.back().get();
+    m_free_size = new_block_size;
+    result = std::align(alignment, size, m_free, m_free_size);
+    assert(result != nullptr);
+  }
+  m_free = static_cast<char*>(m_free) + size;
+  m_free_size -= size;
+  return result;
+}
+
+}
+
 
 Module &ModuleRegistry::create_module(jl_module_t* jmod)
 {
@@ -129,11 +999,140 @@ JLCXX_API ModuleRegistry& registry()
   return m_registry;
 }
 
-JLCXX_API jl_value_t* julia_type(const std::string& name, const std::string& module_name)
+namespace detail
+{
+
+CurrentModuleGuard::CurrentModuleGuard(Module& mod) :
+  m_previous_module(registry().has_current_module() ? &registry().current_module() : nullptr)
+{
+  registry().set_current_module(mod);
+}
+
+CurrentModuleGuard::~CurrentModuleGuard()
+{
+  if(m_previous_module == nullptr)
+  {
+    registry().reset_current_module();
+  }
+  else
+  {
+    registry().set_current_module(*m_previous_module);
+  }
+}
+
+namespace
+{
+  std::unordered_map<type_hash_t, std::shared_ptr<DeferredType>>& deferred_types()
+  {
+    static std::unordered_map<type_hash_t, std::shared_ptr<DeferredType>> m_deferred_types;
+    return m_deferred_types;
+  }
+}
+
+JLCXX_API void add_deferred_type(const type_hash_t& hash, DeferredType&& deferred)
+{
+  deferred_types().emplace(hash, std::make_shared<DeferredType>(std::move(deferred)));
+}
+
+JLCXX_API std::shared_ptr<DeferredType> find_deferred_type(jl_datatype_t* applied_dt)
+{
+  // Copy the candidates first, since computing the parameters may create other deferred types
+  std::vector<std::shared_ptr<DeferredType>> candidates;
+  for(const auto& [hash, deferred] : deferred_types())
+  {
+    if(!deferred->applied && (deferred->dt->name == applied_dt->name || deferred->box_dt->name == applied_dt->name))
+    {
+      candidates.push_back(deferred);
+    }
+  }
+
+  const std::size_t nb_parameters = jl_svec_len(applied_dt->parameters);
+  for(const std::shared_ptr<DeferredType>& deferred : candidates)
+  {
+    jl_svec_t* parameters = deferred->parameters();
+    JL_GC_PUSH1(&parameters);
+    bool matches = jl_svec_len(parameters) == nb_parameters;
+    for(std::size_t i = 0; matches && i != nb_parameters; ++i)
+    {
+      matches = jl_egal(jl_svecref(parameters, i), jl_svecref(applied_dt->parameters, i));
+    }
+    JL_GC_POP();
+    if(matches)
+    {
+      return deferred;
+    }
+  }
+  return nullptr;
+}
+
+JLCXX_API void apply_deferred_type(DeferredType& deferred)
+{
+  if(deferred.applied)
+  {
+    return;
+  }
+  // Marked before applying, since adding the methods may request the type again
+  deferred.applied = true;
+  try
+  {
+    CurrentModuleGuard guard(*deferred.module);
+    deferred.apply(*deferred.module);
+  }
+  catch(...)
+  {
+    deferred.applied = false;
+    throw;
+  }
+}
+
+JLCXX_API bool apply_deferred_type(const type_hash_t& hash)
+{
+  const auto it = deferred_types().find(hash);
+  if(it == deferred_types().end() || it->second->applied)
+  {
+    return false;
+  }
+  // Keep the entry alive, applying may add other deferred types
+  std::shared_ptr<DeferredType> deferred = it->second;
+  apply_deferred_type(*deferred);
+  return true;
+}
+
+}
+
+namespace
+{
+
+/// Key for the results of julia_type(name, module_name): the module and type name symbols, the module being null if none was given
+using type_name_key_t = std::pair<jl_sym_t*, jl_sym_t*>;
+
+struct TypeNameKeyHash
+{
+  std::size_t operator()(const type_name_key_t& k) const noexcept
+  {
+    std::size_t h1 = std::hash<jl_sym_t*>{}(k.first);
+    std::size_t h2 = std::hash<jl_sym_t*>{}(k.second);
+    return h1 ^ (h2 << 1);
+  }
+};
+
+/// Results of julia_type(name, module_name), per module being registered since that module is searched first.
+/// Cleared whenever CxxWrap defines globals, since a new definition may shadow a type found before.
+struct TypeNameCache
+{
+  std::unordered_map<jl_module_t*, std::unordered_map<type_name_key_t, Rooted<jl_value_t>, TypeNameKeyHash>> types;
+};
+
+TypeNameCache& julia_type_cache()
+{
+  static TypeNameCache m_cache;
+  return m_cache;
+}
+
+jl_value_t* find_julia_type(const std::string& name, const std::string& module_name, jl_module_t* current_mod)
 {
   std::vector<jl_module_t*> mods;
   mods.reserve(6);
-  jl_module_t* current_mod = registry().has_current_module() ? registry().current_module().julia_module() : nullptr;
   if(!module_name.empty())
   {
     jl_sym_t* modsym = jl_symbol(module_name.c_str());
@@ -197,6 +1196,56 @@ JLCXX_API jl_value_t* julia_type(const std::string& name, const std::string& mod
   throw std::runtime_error(errmsg);
 }
 
+}
+
+JLCXX_API jl_value_t* julia_type(const std::string& name, const std::string& module_name)
+{
+  jl_module_t* current_mod = registry().has_current_module() ? registry().current_module().julia_module() : nullptr;
+  auto& cache = julia_type_cache().types[current_mod];
+  // Symbols are interned, so the key is found without building a string
+  const type_name_key_t key(module_name.empty() ? nullptr : jl_symbol(module_name.c_str()), jl_symbol(name.c_str()));
+  const auto cached = cache.find(key);
+  if(cached != cache.end())
+  {
+    return cached->second.get();
+  }
+  // The global may be reassigned, so the cache roots the value it found
+  jl_value_t* result = find_julia_type(name, module_name, current_mod);
+  cache.emplace(key, Rooted<jl_value_t>(result));
+  return result;
+}
+
+JLCXX_API void clear_julia_type_cache()
+{
+  julia_type_cache().types.clear();
+}
+
+JLCXX_API const CoreTypes& core_types()
+{
+  static CoreTypes core;
+  static bool initialized = false;
+  if(!initialized)
+  {
+    if(g_cxxwrap_module == nullptr)
+    {
+      throw std::runtime_error("CxxWrap is not initialized, the core CxxWrap types are not available yet");
+    }
+    // Missing types stay null and only throw when used
+    CoreTypes found;
+    for(CoreType* type : {&found.cxx_ref, &found.const_cxx_ref, &found.cxx_ptr, &found.const_cxx_ptr, &found.cxx_const, &found.safe_cfunction,
+                          &found.strictly_typed_number, &found.const_array})
+    {
+      type->value = julia_type(type->name, g_cxxwrap_module);
+    }
+    found.val.value = julia_type(found.val.name, jl_base_module);
+    found.complex.value = julia_type(found.complex.name, jl_base_module);
+    found.ptr.value = julia_type(found.ptr.name, jl_core_module);
+    core = found;
+    initialized = true;
+  }
+  return core;
+}
+
 JLCXX_API jl_value_t* julia_type(const std::string& name, jl_module_t* mod)
 {
   jl_value_t* gval = jl_get_global(mod, jl_symbol(name.c_str()));
@@ -227,20 +1276,89 @@ JLCXX_API jl_datatype_t* apply_type(jl_value_t* tc, jl_datatype_t *t)
 
 static constexpr const char* dt_prefix = "__cxxwrap_dt_";
 
-jl_datatype_t* existing_datatype(jl_module_t* mod, jl_sym_t* name)
+namespace
 {
-  const std::string prefixed_name = dt_prefix + symbol_name(name);
-  jl_value_t* found_dt = jl_get_global(mod, jl_symbol(prefixed_name.c_str()));
-  if(found_dt == nullptr || !jl_is_datatype(found_dt))
+
+/// Datatypes created or found by new_datatype and new_bitstype, per module and keyed by their unprefixed name.
+/// The types are rooted by their __cxxwrap_dt_ constant in the module.
+using created_datatypes_t = std::unordered_map<jl_module_t*, std::unordered_map<jl_sym_t*, jl_datatype_t*>>;
+
+created_datatypes_t& created_datatypes()
+{
+  static created_datatypes_t m_datatypes;
+  return m_datatypes;
+}
+
+/// Types created before the module was first seen, e.g. when it is loaded from a precompile image, as alternating unprefixed names and datatypes
+jl_array_t* previously_created_datatypes(jl_module_t* mod)
+{
+  static jl_function_t* list_datatypes = nullptr;
+  if(list_datatypes == nullptr)
   {
-    return nullptr;
+    list_datatypes = jl_eval_string("(m, prefix) -> begin\n"
+      "  result = Any[]\n"
+      "  for n in names(m; all = true)\n"
+      "    s = string(n)\n"
+      "    if startswith(s, prefix) && isdefined(m, n) && getfield(m, n) isa DataType\n"
+      "      push!(result, Symbol(s[ncodeunits(prefix)+1:end]), getfield(m, n))\n"
+      "    end\n"
+      "  end\n"
+      "  result\n"
+      "end");
+    protect_from_gc_permanently(list_datatypes);
   }
-  return (jl_datatype_t*)found_dt;
+  jl_value_t* prefix = jl_cstr_to_string(dt_prefix);
+  JL_GC_PUSH1(&prefix);
+  jl_array_t* result = (jl_array_t*)jl_call2(list_datatypes, (jl_value_t*)mod, prefix);
+  JL_GC_POP();
+  return result;
 }
 
-void set_internal_constant(jl_module_t* mod, jl_datatype_t* dt, const std::string& prefixed_name)
+/// Entries for the module, filled from the existing constants the first time the module is seen
+std::unordered_map<jl_sym_t*, jl_datatype_t*>& module_datatypes(jl_module_t* mod)
 {
+  created_datatypes_t& datatypes = created_datatypes();
+  auto it = datatypes.find(mod);
+  if(it != datatypes.end())
+  {
+    return it->second;
+  }
+
+  std::unordered_map<jl_sym_t*, jl_datatype_t*>& result = datatypes[mod];
+  jl_array_t* previous = previously_created_datatypes(mod);
+  if(previous == nullptr)
+  {
+    datatypes.erase(mod);
+    throw std::runtime_error("Failed to list the existing types of module " + module_name(mod));
+  }
+  JL_GC_PUSH1(&previous);
+  ArrayRef<jl_value_t*> previous_ref(previous);
+  for(std::size_t i = 0; i+1 < previous_ref.size(); i += 2)
+  {
+    result[(jl_sym_t*)previous_ref[i]] = (jl_datatype_t*)previous_ref[i+1];
+  }
+  // The table is keyed by address, so the module must not be collected and its address reused by a new module.
+  // This also keeps the datatypes alive, since they are constants of the module.
+  protect_from_gc_permanently(mod);
+  JL_GC_POP();
+  return result;
+}
+
+}
+
+jl_datatype_t* existing_datatype(jl_module_t* mod, jl_sym_t* name)
+{
+  const std::unordered_map<jl_sym_t*, jl_datatype_t*>& datatypes = module_datatypes(mod);
+  const auto found = datatypes.find(name);
+  return found == datatypes.end() ? nullptr : found->second;
+}
+
+void set_internal_constant(jl_module_t* mod, jl_datatype_t* dt, jl_sym_t* name)
+{
+  const std::string prefixed_name = dt_prefix + symbol_name(name);
   jl_set_const(mod, jl_symbol(prefixed_name.c_str()), (jl_value_t*)dt);
+  module_datatypes(mod)[name] = dt;
+  clear_julia_type_cache();
 }
 
 JLCXX_API jl_datatype_t* new_datatype(jl_sym_t *name,
@@ -267,7 +1385,7 @@ JLCXX_API jl_datatype_t* new_datatype(jl_sym_t *name,
 #endif
     abstract, mutabl, ninitialized);
 
-  set_internal_constant(module, dt, dt_prefix + symbol_name(name));
+  set_internal_constant(module, dt, name);
   return dt;
 }
 
@@ -284,7 +1402,7 @@ JLCXX_API jl_datatype_t* new_bitstype(jl_sym_t *name,
   }
 
   dt = jl_new_primitivetype((jl_value_t*)name, module, super, parameters, nbits);
-  set_internal_constant(module, dt, dt_prefix + symbol_name(name));
+  set_internal_constant(module, dt, name);
   return dt;
 }
 
@@ -412,6 +1530,8 @@ JLCXX_API void register_core_cxxwrap_types()
     
     jlcxx::detail::AddIntegerTypes<fundamental_int_types>()("", "Cxx");
 
+    core_types();
+
     registered = true;
   }
 }
@@ -0,0 +1,258 @@
+#include "jlcxx/metadata_cache.hpp"
+#include "jlcxx/jlcxx.hpp"
+#include "jlcxx/stl.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <dlfcn.h>
+#endif
+
+#ifdef __linux__
+  #include <link.h>
+#endif
+
+namespace jlcxx
+{
+
+namespace
+{
+
+#ifdef __linux__
+struct BuildIdSearch
+{
+  uintptr_t address;
+  std::string build_id;
+};
+
+std::size_t align_note(const std::size_t n)
+{
+  return (n + 3) & ~std::size_t(3);
+}
+
+// dl_iterate_phdr callback extracting the NT_GNU_BUILD_ID note of the object containing the address
+int find_build_id(dl_phdr_info* info, std::size_t, void* data)
+{
+  BuildIdSearch& search = *static_cast<BuildIdSearch*>(data);
+  bool contains_address = false;
+  for(int i = 0; i != info->dlpi_phnum; ++i)
+  {
+    const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+    const uintptr_t start = info->dlpi_addr + phdr.p_vaddr;
+    if(phdr.p_type == PT_LOAD && search.address >= start && search.address < start + phdr.p_memsz)
+    {
+      contains_address = true;
+    }
+  }
+  if(!contains_address)
+  {
+    return 0;
+  }
+
+  for(int i = 0; i != info->dlpi_phnum; ++i)
+  {
+    const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+    if(phdr.p_type != PT_NOTE)
+    {
+      continue;
+    }
+    const char* note = reinterpret_cast<const char*>(info->dlpi_addr + phdr.p_vaddr);
+    const char* notes_end = note + phdr.p_memsz;
+    while(note + sizeof(ElfW(Nhdr)) <= notes_end)
+    {
+      const ElfW(Nhdr)* header = reinterpret_cast<const ElfW(Nhdr)*>(note);
+      const char* name = note + sizeof(ElfW(Nhdr));
+      const unsigned char* desc = reinterpret_cast<const unsigned char*>(name + align_note(header->n_namesz));
+      if(header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 && std::memcmp(name, "GNU", 4) == 0)
+      {
+        std::stringstream hex_id;
+        for(std::size_t j = 0; j != header->n_descsz; ++j)
+        {
+          hex_id << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(desc[j]);
+        }
+        search.build_id = hex_id.str();
+        return 1;
+      }
+      note = reinterpret_cast<const char*>(desc) + align_note(header->n_descsz);
+    }
+  }
+  return 1;
+}
+#endif
+
+std::string library_path(const void* address)
+{
+#ifdef _WIN32
+  HMODULE handle = nullptr;
+  char path[MAX_PATH];
+  if(!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, static_cast<LPCSTR>(address), &handle)
+    || GetModuleFileNameA(handle, path, MAX_PATH) == 0)
+  {
+    throw std::runtime_error("Could not find the library for address " + std::to_string(reinterpret_cast<uintptr_t>(address)));
+  }
+  return path;
+#else
+  Dl_info info;
+  if(dladdr(address, &info) == 0 || info.dli_fname == nullptr)
+  {
+    throw std::runtime_error("Could not find the library for address " + std::to_string(reinterpret_cast<uintptr_t>(address)));
+  }
+  return info.dli_fname;
+#endif
+}
+
+/// Text representation of any Julia value, as printed by Base.string, or by Base.repr if as_code is true (e.g. to keep the quotes of string values)
+std::string julia_string_repr(jl_value_t* v, const bool as_code = false)
+{
+  if(v == nullptr)
+  {
+    return "#undef";
+  }
+  if(jl_is_symbol(v))
+  {
+    return symbol_name((jl_sym_t*)v);
+  }
+  static jl_function_t* string_function = jl_get_function(jl_base_module, "string");
+  static jl_function_t* repr_function = jl_get_function(jl_base_module, "repr");
+  jl_value_t* result = jl_call1(as_code ? repr_function : string_function, v);
+  if(result == nullptr)
+  {
+    throw std::runtime_error("Could not convert value to string for the metadata cache");
+  }
+  return julia_string(result);
+}
+
+/// Length-prefixed, so fields can contain newlines
+void write_field(std::ostream& out, const std::string& field)
+{
+  out << field.size() << ':' << field << '\n';
+}
+
+void write_field(std::ostream& out, jl_value_t* field)
+{
+  write_field(out, julia_string_repr(field));
+}
+
+std::string cache_header(const Module& mod)
+{
+  if(mod.library_address() == nullptr)
+  {
+    throw std::runtime_error("Module " + mod.name() + " was not registered through register_julia_module, its library is unknown");
+  }
+  std::stringstream header;
+  write_field(header, "cxxwrap_julia " JLCXX_VERSION_STRING);
+  write_field(header, library_build_id(mod.library_address()));
+  // Lazy STL containers change the exported functions, call statistics the pointers and thunks
+  write_field(header, std::string("lazy_stl ") + (stl::StlWrappers::lazy() ? "1" : "0"));
+  write_field(header, std::string("call_statistics ") + (call_statistics_enabled() ? "1" : "0"));
+  return header.str();
+}
+
+/// Open the cache file and skip the header, returning a closed stream if the header doesn't match
+std::ifstream open_valid_cache(const Module& mod, const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  if(!in)
+  {
+    return in;
+  }
+  const std::string expected = cache_header(mod);
+  std::string stored(expected.size(), '\0');
+  in.read(&stored[0], expected.size());
+  if(!in || stored != expected)
+  {
+    in.close();
+  }
+  return in;
+}
+
+}
+
+JLCXX_API std::string library_build_id(const void* address)
+{
+#ifdef __linux__
+  BuildIdSearch search { reinterpret_cast<uintptr_t>(address), "" };
+  dl_iterate_phdr(find_build_id, &search);
+  if(!search.build_id.empty())
+  {
+    return search.build_id;
+  }
+#endif
+  const std::string path = library_path(address);
+  std::stringstream build_id;
+  build_id << path << ':' << std::filesystem::file_size(path) << ':' << std::filesystem::last_write_time(path).time_since_epoch().count();
+  return build_id.str();
+}
+
+JLCXX_API std::string module_metadata(const Module& mod)
+{
+  std::stringstream metadata;
+  mod.for_each_function([&] (FunctionWrapperBase& f)
+  {
+    write_field(metadata, f.name());
+    write_field(metadata, f.override_module());
+    write_field(metadata, f.doc());
+    write_field(metadata, (jl_value_t*)f.return_type().first);
+    write_field(metadata, (jl_value_t*)f.return_type().second);
+    const auto argument_types = f.argument_types();
+    metadata << argument_types.size() << '\n';
+    for(jl_datatype_t* dt : argument_types)
+    {
+      write_field(metadata, (jl_value_t*)dt);
+    }
+    metadata << f.argument_names().size() << ' ' << f.number_of_keyword_arguments() << '\n';
+    for(jl_value_t* argname : f.argument_names())
+    {
+      write_field(metadata, argname);
+    }
+    for(jl_value_t* default_value : f.argument_default_values())
+    {
+      write_field(metadata, julia_string_repr(default_value, true));
+    }
+  });
+  metadata << "box_types " << mod.box_types().size() << '\n';
+  for(jl_datatype_t* dt : mod.box_types())
+  {
+    write_field(metadata, (jl_value_t*)dt);
+  }
+  return metadata.str();
+}
+
+JLCXX_API void write_metadata_cache(const Module& mod, const std::string& path)
+{
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out << cache_header(mod) << module_metadata(mod);
+  if(!out)
+  {
+    throw std::runtime_error("Failed to write metadata cache " + path);
+  }
+}
+
+JLCXX_API bool metadata_cache_is_valid(const Module& mod, const std::string& path)
+{
+  return open_valid_cache(mod, path).is_open();
+}
+
+JLCXX_API std::optional<std::string> read_metadata_cache(const Module& mod, const std::string& path)
+{
+  std::ifstream in = open_valid_cache(mod, path);
+  if(!in.is_open())
+  {
+    return std::nullopt;
+  }
+  std::stringstream metadata;
+  metadata << in.rdbuf();
+  if(in.bad())
+  {
+    throw std::runtime_error("Failed to read metadata cache " + path);
+  }
+  return metadata.str();
+}
+
+}
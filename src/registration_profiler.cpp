@@ -0,0 +1,168 @@
+#include "jlcxx/registration_profiler.hpp"
+#include "jlcxx/julia_headers.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <utility>
+
+#ifdef __GNUG__
+  #include <cxxabi.h>
+#endif
+
+namespace jlcxx
+{
+
+namespace
+{
+
+std::atomic<bool>& registration_profile_flag()
+{
+  static std::atomic<bool> m_enabled(std::getenv("JLCXX_REGISTRATION_PROFILE") != nullptr);
+  return m_enabled;
+}
+
+/// Phase in progress
+struct OpenPhase
+{
+  std::size_t entry;
+  std::chrono::steady_clock::time_point start;
+  int64_t start_bytes;
+  uint64_t nested_ns;
+};
+
+struct RegistrationProfile
+{
+  std::vector<RegistrationProfileEntry> entries;
+  std::map<std::pair<std::string, std::string>, std::size_t> entry_index;
+  std::vector<OpenPhase> open_phases;
+};
+
+RegistrationProfile& profile()
+{
+  static RegistrationProfile m_profile;
+  return m_profile;
+}
+
+std::string demangle(const char* name)
+{
+#ifdef __GNUG__
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+  if(status == 0 && demangled != nullptr)
+  {
+    std::string result(demangled);
+    std::free(demangled);
+    return result;
+  }
+#endif
+  return name;
+}
+
+}
+
+JLCXX_API void set_registration_profile_enabled(const bool enabled)
+{
+  registration_profile_flag() = enabled;
+}
+
+JLCXX_API bool registration_profile_enabled()
+{
+  return registration_profile_flag();
+}
+
+JLCXX_API std::vector<RegistrationProfileEntry> registration_profile()
+{
+  return profile().entries;
+}
+
+JLCXX_API void reset_registration_profile()
+{
+  // Phases still open keep their entry, so they can be closed
+  RegistrationProfile& p = profile();
+  for(RegistrationProfileEntry& entry : p.entries)
+  {
+    entry.count = 0;
+    entry.total_ns = 0;
+    entry.self_ns = 0;
+    entry.julia_bytes = 0;
+  }
+}
+
+JLCXX_API std::string registration_profile_report()
+{
+  std::vector<RegistrationProfileEntry> entries = registration_profile();
+  std::stable_sort(entries.begin(), entries.end(), [] (const RegistrationProfileEntry& a, const RegistrationProfileEntry& b) { return a.self_ns > b.self_ns; });
+
+  std::stringstream report;
+  report << std::setw(12) << "self (ms)" << std::setw(12) << "total (ms)" << std::setw(10) << "count" << std::setw(14) << "julia bytes" << "  phase: label\n";
+  report << std::fixed << std::setprecision(3);
+  for(const RegistrationProfileEntry& entry : entries)
+  {
+    if(entry.count == 0)
+    {
+      continue;
+    }
+    report << std::setw(12) << entry.self_ns * 1e-6 << std::setw(12) << entry.total_ns * 1e-6 << std::setw(10) << entry.count
+      << std::setw(14) << entry.julia_bytes << "  " << entry.phase << ": " << entry.label << "\n";
+  }
+  return report.str();
+}
+
+namespace detail
+{
+
+JLCXX_API void reset_registration_phases()
+{
+  profile().open_phases.clear();
+}
+
+void RegistrationPhase::start(const char* phase, const char* label)
+{
+  RegistrationProfile& p = profile();
+  auto key = std::make_pair(std::string(phase), demangle(label));
+  auto it = p.entry_index.find(key);
+  if(it == p.entry_index.end())
+  {
+    RegistrationProfileEntry entry;
+    entry.phase = key.first;
+    entry.label = key.second;
+    p.entries.push_back(std::move(entry));
+    it = p.entry_index.emplace(std::move(key), p.entries.size() - 1).first;
+  }
+  m_depth = p.open_phases.size();
+  p.open_phases.push_back(OpenPhase { it->second, std::chrono::steady_clock::now(), jl_gc_total_bytes(), 0 });
+}
+
+void RegistrationPhase::stop()
+{
+  RegistrationProfile& p = profile();
+  if(p.open_phases.size() <= m_depth)
+  {
+    // Discarded by reset_registration_phases
+    return;
+  }
+  // Phases above this one were never closed, because a Julia error jumped over their destructors
+  p.open_phases.resize(m_depth + 1);
+  const OpenPhase phase = p.open_phases.back();
+  p.open_phases.pop_back();
+
+  const uint64_t elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - phase.start).count();
+  RegistrationProfileEntry& entry = p.entries[phase.entry];
+  entry.count += 1;
+  entry.total_ns += elapsed_ns;
+  entry.self_ns += elapsed_ns - std::min(elapsed_ns, phase.nested_ns);
+  entry.julia_bytes += jl_gc_total_bytes() - phase.start_bytes;
+  if(!p.open_phases.empty())
+  {
+    p.open_phases.back().nested_ns += elapsed_ns;
+  }
+}
+
+}
+
+}
@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <string>
 #include <thread>
 #include <vector>
@@ -9,22 +10,69 @@
 namespace jlcxx
 {
 
+#define JLCXX_DEFINE_STL_INSTANTIATIONS(T) JLCXX_STL_INSTANTIATIONS(, T)
+JLCXX_FOR_EACH_STL_TYPE(JLCXX_DEFINE_STL_INSTANTIATIONS)
+#undef JLCXX_DEFINE_STL_INSTANTIATIONS
+
+#define JLCXX_COUNT_STL_TYPE(T) + 1
+static_assert(0 JLCXX_FOR_EACH_STL_TYPE(JLCXX_COUNT_STL_TYPE) == stl::stltypes::nb_parameters, "JLCXX_FOR_EACH_STL_TYPE must list the types in stltypes");
+#undef JLCXX_COUNT_STL_TYPE
+
 namespace stl
 {
 
 JLCXX_API std::unique_ptr<StlWrappers> StlWrappers::m_instance = std::unique_ptr<StlWrappers>();
 
+namespace
+{
+
+/// Create the julia types of all containers and smart pointers of T, which adds their methods
+template<typename T>
+void create_containers()
+{
+  create_if_not_exists<std::vector<T>>();
+  create_if_not_exists<std::valarray<T>>();
+  create_if_not_exists<std::deque<T>>();
+  create_if_not_exists<std::queue<T>>();
+  create_if_not_exists<std::shared_ptr<T>>();
+  create_if_not_exists<std::weak_ptr<T>>();
+  create_if_not_exists<std::unique_ptr<T>>();
+}
+
+struct CreateContainers
+{
+  template<typename T>
+  void operator()()
+  {
+    create_containers<T>();
+  }
+};
+
+struct RegisterLazyElementType
+{
+  template<typename T>
+  void operator()()
+  {
+    m_element_types[julia_type<T>()] = create_containers<T>;
+  }
+
+  std::map<jl_datatype_t*, void(*)()>& m_element_types;
+};
+
+}
+
 JLCXX_API void StlWrappers::instantiate(Module& mod)
 {
+  detail::RegistrationPhase phase("stl_instantiate", lazy() ? "lazy" : "eager");
   m_instance.reset(new StlWrappers(mod));
-  m_instance->vector.apply_combination<std::vector, stltypes>(stl::WrapVector());
-  m_instance->valarray.apply_combination<std::valarray, stltypes>(stl::WrapValArray());
-  m_instance->dequeIterator.apply_combination<stl::DequeIteratorWrapper, stltypes>(stl::WrapIterator());
-  m_instance->deque.apply_combination<std::deque, stltypes>(stl::WrapDeque());
-  m_instance->queue.apply_combination<std::queue, stltypes>(stl::WrapQueue());
-  smartptr::apply_smart_combination<std::shared_ptr, stltypes>();
-  smartptr::apply_smart_combination<std::weak_ptr, stltypes>();
-  smartptr::apply_smart_combination<std::unique_ptr, stltypes>();
+  if(lazy())
+  {
+    // Only remember how to create the containers, the factories create them on first use
+    for_each_type<stltypes>(RegisterLazyElementType{m_instance->m_lazy_element_types});
+    return;
+  }
+  // Goes through the explicitly instantiated apply_stl and apply_smart_pointer_type, so their code isn't duplicated
+  for_each_type<stltypes>(CreateContainers());
 }
 
 JLCXX_API StlWrappers& StlWrappers::instance()
@@ -36,6 +84,24 @@ JLCXX_API StlWrappers& StlWrappers::instance()
   return *m_instance;
 }
 
+JLCXX_API bool StlWrappers::lazy()
+{
+  static const bool m_lazy = std::getenv("JLCXX_LAZY_STL") != nullptr;
+  return m_lazy;
+}
+
+JLCXX_API bool StlWrappers::instantiate_element_type(jl_datatype_t* element_type)
+{
+  const auto it = m_lazy_element_types.find(element_type);
+  if(it == m_lazy_element_types.end())
+  {
+    return false;
+  }
+  detail::CurrentModuleGuard guard(m_stl_mod);
+  it->second();
+  return true;
+}
+
 JLCXX_API StlWrappers& wrappers()
 {
   return StlWrappers::instance();
@@ -96,6 +162,14 @@ JLCXX_MODULE define_cxxwrap_stl_module(jlcxx::Module& stl)
 
   stl.method("hardware_concurrency", [] () { return std::thread::hardware_concurrency(); });
 
+  // Handle returned by functions registered with jlcxx::async
+  stl.add_type<jlcxx::AsyncCall>("AsyncCall");
+  stl.set_override_module(jl_base_module);
+  stl.method("wait", [] (jlcxx::AsyncCall& call) { call.wait(); });
+  stl.method("fetch", [] (jlcxx::AsyncCall& call) { return call.fetch(); });
+  stl.method("istaskdone", [] (const jlcxx::AsyncCall& call) { return call.done(); });
+  stl.unset_override_module();
+
   jlcxx::add_smart_pointer<std::shared_ptr>(stl, "SharedPtr");
   jlcxx::add_smart_pointer<std::weak_ptr>(stl, "WeakPtr");
   jlcxx::add_smart_pointer<std::unique_ptr>(stl, "UniquePtr");
@@ -105,3 +179,26 @@ JLCXX_MODULE define_cxxwrap_stl_module(jlcxx::Module& stl)
 
 }
 
+extern "C"
+{
+
+/// With JLCXX_LAZY_STL, create the STL containers of a basic element type when Julia first needs one of them.
+/// Returns the number of functions the STL module had before, so the caller can export the functions from that index on
+/// (see get_module_functions_from), or -1 if the element type is not one of the basic STL types.
+JLCXX_API jlcxx::cxxint_t instantiate_stl_containers(jl_datatype_t* element_type)
+{
+  try
+  {
+    jlcxx::stl::StlWrappers& wrappers = jlcxx::stl::StlWrappers::instance();
+    const jlcxx::cxxint_t nb_functions = wrappers.stl_module().num_functions();
+    return wrappers.instantiate_element_type(element_type) ? nb_functions : -1;
+  }
+  catch(const std::exception& e)
+  {
+    jl_error(e.what());
+  }
+  return -1;
+}
+
+}
+
@@ -0,0 +1,526 @@
+#include <atomic>
+#include <future>
+#include <map>
+#include <random>
+#include <set>
+#include <thread>
+
+#include <jlcxx/jlcxx.hpp>
+#include <jlcxx/functions.hpp>
+
+namespace
+{
+
+// Expected number of protects of each value created by the test
+using counts_t = std::map<jl_value_t*, std::size_t>;
+
+/// Boxed integers, kept alive by a Julia array, so the test can unprotect them all without them being collected
+struct TestValues
+{
+  TestValues(const std::size_t n) : array(n)
+  {
+    jlcxx::protect_from_gc_permanently(array.wrapped());
+    for(std::size_t i = 0; i != n; ++i)
+    {
+      // Large enough to not be one of the cached small integer boxes
+      jl_value_t* v = jl_box_int64(static_cast<int64_t>(i) + 1000000);
+      array.set(i, v);
+      values.push_back(v);
+    }
+    value_set.insert(values.begin(), values.end());
+  }
+
+  jlcxx::Array<jl_value_t*> array;
+  std::vector<jl_value_t*> values;
+  std::set<jl_value_t*> value_set;
+};
+
+counts_t protected_counts(const TestValues& test_values)
+{
+  counts_t result;
+  for(const jlcxx::GCRootEntry& entry : jlcxx::gc_root_entries())
+  {
+    if(test_values.value_set.count(entry.value) != 0)
+    {
+      result[entry.value] = entry.count;
+    }
+  }
+  return result;
+}
+
+void check_counts(const std::string& step, const TestValues& test_values, const counts_t& expected, const std::size_t nb_protected_before)
+{
+  if(protected_counts(test_values) != expected)
+  {
+    throw std::runtime_error("unexpected protect counts after " + step);
+  }
+  if(jlcxx::gc_root_stats().nb_protected != nb_protected_before + expected.size())
+  {
+    throw std::runtime_error("unexpected number of protected values after " + step);
+  }
+}
+
+void test_duplicates(const TestValues& test_values, const std::size_t nb_protected_before)
+{
+  jl_value_t* v = test_values.values[0];
+  counts_t expected;
+  for(std::size_t i = 1; i != 4; ++i)
+  {
+    jlcxx::protect_from_gc(v);
+    expected[v] = i;
+    check_counts("protecting a value " + std::to_string(i) + " times", test_values, expected, nb_protected_before);
+  }
+  for(std::size_t i = 3; i != 0; --i)
+  {
+    jlcxx::unprotect_from_gc(v);
+    if(i == 1)
+    {
+      expected.erase(v);
+    }
+    else
+    {
+      expected[v] = i-1;
+    }
+    check_counts("unprotecting a duplicate", test_values, expected, nb_protected_before);
+  }
+}
+
+void test_unprotect_unprotected(const TestValues& test_values, const std::size_t nb_protected_before)
+{
+  jlcxx::protect_from_gc(test_values.values[0]);
+  bool thrown = false;
+  try
+  {
+    jlcxx::unprotect_from_gc(test_values.values[1]);
+  }
+  catch(const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  if(!thrown)
+  {
+    throw std::runtime_error("unprotecting a value that was not protected didn't throw");
+  }
+  check_counts("unprotecting a value that was not protected", test_values, counts_t { {test_values.values[0], 1} }, nb_protected_before);
+  jlcxx::unprotect_from_gc(test_values.values[0]);
+  check_counts("unprotecting the remaining value", test_values, counts_t(), nb_protected_before);
+}
+
+/// Fill the table far beyond its initial capacity and empty it again, collecting garbage at the largest size
+void test_grow_shrink(const TestValues& test_values, const std::size_t nb_protected_before)
+{
+  counts_t expected;
+  for(jl_value_t* v : test_values.values)
+  {
+    jlcxx::protect_from_gc(v);
+    expected[v] = 1;
+  }
+  check_counts("protecting all values", test_values, expected, nb_protected_before);
+  jl_gc_collect(JL_GC_FULL);
+  check_counts("collecting with all values protected", test_values, expected, nb_protected_before);
+  for(jl_value_t* v : test_values.values)
+  {
+    jlcxx::unprotect_from_gc(v);
+    expected.erase(v);
+  }
+  check_counts("unprotecting all values", test_values, expected, nb_protected_before);
+}
+
+/// Random protects and unprotects, checked against the expected counts
+void test_random(const TestValues& test_values, const std::size_t nb_protected_before)
+{
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<std::size_t> pick_value(0, test_values.values.size()-1);
+  std::bernoulli_distribution pick_protect(0.55);
+  counts_t expected;
+  for(std::size_t i = 0; i != 200000; ++i)
+  {
+    jl_value_t* v = test_values.values[pick_value(generator)];
+    const auto it = expected.find(v);
+    if(it == expected.end() || pick_protect(generator))
+    {
+      jlcxx::protect_from_gc(v);
+      ++expected[v];
+    }
+    else
+    {
+      jlcxx::unprotect_from_gc(v);
+      if(--it->second == 0)
+      {
+        expected.erase(it);
+      }
+    }
+    if(i % 20000 == 0)
+    {
+      check_counts("random step " + std::to_string(i), test_values, expected, nb_protected_before);
+      jl_gc_collect(JL_GC_FULL);
+    }
+  }
+  check_counts("random steps", test_values, expected, nb_protected_before);
+
+  for(const auto& entry : expected)
+  {
+    for(std::size_t i = 0; i != entry.second; ++i)
+    {
+      jlcxx::unprotect_from_gc(entry.first);
+    }
+  }
+  check_counts("unprotecting after the random steps", test_values, counts_t(), nb_protected_before);
+}
+
+/// A protect done by another thread, still in the buffer of that thread, must be merged before unprotecting
+void test_unprotect_from_other_thread(const TestValues& test_values, const std::size_t nb_protected_before)
+{
+  jl_value_t* v = test_values.values[0];
+  std::promise<void> protected_promise;
+  std::promise<void> unprotected_promise;
+  std::thread protecting_thread([&] ()
+  {
+    jlcxx::protect_from_gc(v);
+    protected_promise.set_value();
+    // Keep the thread alive, so its buffer is only merged by the unprotect
+    unprotected_promise.get_future().wait();
+  });
+  protected_promise.get_future().wait();
+  jlcxx::unprotect_from_gc(v);
+  unprotected_promise.set_value();
+  protecting_thread.join();
+  check_counts("unprotecting a value protected by another thread", test_values, counts_t(), nb_protected_before);
+}
+
+/// Unprotects first cancel the protects still in the buffer of the calling thread, then use the ones of other threads and the table
+void test_unprotect_staged(const TestValues& test_values, const std::size_t nb_protected_before)
+{
+  jl_value_t* v = test_values.values[0];
+  jl_value_t* w = test_values.values[1];
+  std::promise<void> protected_promise;
+  std::promise<void> unprotected_promise;
+  std::thread protecting_thread([&] ()
+  {
+    jlcxx::protect_from_gc(v);
+    protected_promise.set_value();
+    unprotected_promise.get_future().wait();
+  });
+  protected_promise.get_future().wait();
+  jlcxx::protect_from_gc(w);
+  // Merges all buffers into the table
+  check_counts("protecting w", test_values, counts_t { {v, 1}, {w, 1} }, nb_protected_before);
+  jlcxx::protect_from_gc(v);
+  jlcxx::protect_from_gc(v);
+  jlcxx::protect_from_gc(w);
+  jlcxx::unprotect_from_gc(v);
+  jlcxx::unprotect_from_gc(w);
+  jlcxx::unprotect_from_gc(w);
+  check_counts("unprotecting staged values", test_values, counts_t { {v, 2} }, nb_protected_before);
+  jlcxx::unprotect_from_gc(v);
+  jlcxx::unprotect_from_gc(v);
+  unprotected_promise.set_value();
+  protecting_thread.join();
+  check_counts("unprotecting all", test_values, counts_t(), nb_protected_before);
+  bool thrown = false;
+  try
+  {
+    jlcxx::unprotect_from_gc(v);
+  }
+  catch(const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  if(!thrown)
+  {
+    throw std::runtime_error("unprotecting a value more often than it was protected didn't throw");
+  }
+}
+
+/// Protects still buffered when a thread exits must be kept
+void test_thread_exit(const TestValues& test_values, const std::size_t nb_protected_before)
+{
+  counts_t expected;
+  for(std::size_t i = 0; i != 100; ++i)
+  {
+    expected[test_values.values[i]] = 2;
+  }
+  std::thread protecting_thread([&] ()
+  {
+    for(const auto& entry : expected)
+    {
+      jlcxx::protect_from_gc(entry.first);
+      jlcxx::protect_from_gc(entry.first);
+    }
+  });
+  protecting_thread.join();
+  check_counts("exiting a thread that protected values", test_values, expected, nb_protected_before);
+  for(const auto& entry : expected)
+  {
+    jlcxx::unprotect_from_gc(entry.first);
+    jlcxx::unprotect_from_gc(entry.first);
+  }
+  check_counts("unprotecting the values of an exited thread", test_values, counts_t(), nb_protected_before);
+}
+
+/// Threads protect and unprotect their own values and set Rooted handles, while this thread collects garbage, scanning the roots
+void test_concurrent_scans(const TestValues& test_values, const std::size_t nb_protected_before)
+{
+  const std::size_t nb_threads = 4;
+  const std::size_t values_per_thread = test_values.values.size() / nb_threads;
+  std::atomic<std::size_t> nb_running(nb_threads);
+  std::vector<std::thread> threads;
+  for(std::size_t t = 0; t != nb_threads; ++t)
+  {
+    threads.emplace_back([&, t] ()
+    {
+      const auto first = test_values.values.begin() + t*values_per_thread;
+      const std::vector<jl_value_t*> values(first, first + values_per_thread);
+      std::mt19937 generator(t);
+      std::uniform_int_distribution<std::size_t> pick_value(0, values.size()-1);
+      std::map<jl_value_t*, std::size_t> counts;
+      jlcxx::Rooted<jl_value_t> rooted;
+      for(std::size_t i = 0; i != 50000; ++i)
+      {
+        jl_value_t* v = values[pick_value(generator)];
+        if(counts[v] == 0 || i % 2 == 0)
+        {
+          jlcxx::protect_from_gc(v);
+          ++counts[v];
+        }
+        else
+        {
+          jlcxx::unprotect_from_gc(v);
+          --counts[v];
+        }
+        rooted.set(v);
+        if(i % 1000 == 0)
+        {
+          rooted.reset();
+        }
+      }
+      for(const auto& entry : counts)
+      {
+        for(std::size_t i = 0; i != entry.second; ++i)
+        {
+          jlcxx::unprotect_from_gc(entry.first);
+        }
+      }
+      --nb_running;
+    });
+  }
+  while(nb_running != 0)
+  {
+    jl_gc_collect(JL_GC_FULL);
+  }
+  for(std::thread& thread : threads)
+  {
+    thread.join();
+  }
+  check_counts("concurrent protects and scans", test_values, counts_t(), nb_protected_before);
+}
+
+std::size_t nb_rooted_slots()
+{
+  return jlcxx::gc_root_stats().nb_rooted_slots;
+}
+
+void check_rooted_slots(const std::string& step, const std::size_t expected)
+{
+  if(nb_rooted_slots() != expected)
+  {
+    throw std::runtime_error("unexpected number of rooted slots after " + step + ": " + std::to_string(nb_rooted_slots()) + " instead of " + std::to_string(expected));
+  }
+}
+
+void test_rooted(const TestValues& test_values)
+{
+  const std::size_t slots_before = nb_rooted_slots();
+  jl_value_t* v1 = test_values.values[0];
+  jl_value_t* v2 = test_values.values[1];
+  {
+    jlcxx::Rooted<jl_value_t> empty;
+    check_rooted_slots("creating an empty handle", slots_before);
+
+    jlcxx::Rooted<jl_value_t> a(v1);
+    check_rooted_slots("rooting a value", slots_before + 1);
+
+    jlcxx::Rooted<jl_value_t> b(std::move(a));
+    if(a.get() != nullptr || b.get() != v1)
+    {
+      throw std::runtime_error("move construction didn't transfer the value");
+    }
+    check_rooted_slots("move construction", slots_before + 1);
+
+    jlcxx::Rooted<jl_value_t> c(v2);
+    c = std::move(b);
+    if(b.get() != nullptr || c.get() != v1)
+    {
+      throw std::runtime_error("move assignment didn't transfer the value");
+    }
+    check_rooted_slots("move assignment, releasing the slot of the target", slots_before + 1);
+
+    c.set(v2);
+    if(c.get() != v2)
+    {
+      throw std::runtime_error("set didn't replace the value");
+    }
+    check_rooted_slots("setting a new value", slots_before + 1);
+
+    c.reset();
+    if(c.get() != nullptr)
+    {
+      throw std::runtime_error("reset didn't clear the handle");
+    }
+    check_rooted_slots("reset", slots_before);
+
+    empty.set(v1);
+    check_rooted_slots("setting an empty handle", slots_before + 1);
+  }
+  check_rooted_slots("destroying the handles", slots_before);
+
+  // A value only rooted by a handle survives a collection
+  jlcxx::Rooted<jl_value_t> boxed(jl_box_int64(123456789));
+  jl_gc_collect(JL_GC_FULL);
+  if(jl_unbox_int64(boxed.get()) != 123456789)
+  {
+    throw std::runtime_error("value rooted by a handle was not kept alive");
+  }
+}
+
+/// Released slots are reused before new ones are allocated
+void test_slot_reuse()
+{
+  jl_value_t** slot = jlcxx::detail::acquire_root_slot();
+  jlcxx::detail::release_root_slot(slot);
+  jl_value_t** reused = jlcxx::detail::acquire_root_slot();
+  if(reused != slot)
+  {
+    throw std::runtime_error("released slot was not reused");
+  }
+  if(*reused != nullptr)
+  {
+    throw std::runtime_error("reused slot was not cleared");
+  }
+  jlcxx::detail::release_root_slot(reused);
+
+  std::vector<jl_value_t**> slots;
+  jlcxx::detail::acquire_root_slots(slots, 3000);
+  if(std::set<jl_value_t**>(slots.begin(), slots.end()).size() != slots.size())
+  {
+    throw std::runtime_error("acquired the same slot twice");
+  }
+  jlcxx::detail::release_root_slots(slots);
+}
+
+/// A scope takes slots in batches, and releases them all at its end
+void test_root_scope(const TestValues& test_values)
+{
+  const std::size_t slots_before = nb_rooted_slots();
+  {
+    jlcxx::RootScope scope;
+    check_rooted_slots("creating a scope", slots_before);
+    for(std::size_t i = 0; i != 100; ++i)
+    {
+      if(scope.root(test_values.values[i]) != test_values.values[i])
+      {
+        throw std::runtime_error("root didn't return its argument");
+      }
+    }
+    if(scope.size() != 100)
+    {
+      throw std::runtime_error("unexpected number of values in the scope");
+    }
+    // Batches of 32 slots
+    check_rooted_slots("rooting 100 values in a scope", slots_before + 128);
+    jl_gc_collect(JL_GC_FULL);
+  }
+  check_rooted_slots("leaving a scope", slots_before);
+}
+
+/// Values first protected after a checkpoint are reported as new, also after the table was resized
+void test_checkpoint(const TestValues& test_values, const std::size_t nb_protected_before)
+{
+  const std::size_t nb_old = 1000;
+  for(std::size_t i = 0; i != nb_old; ++i)
+  {
+    jlcxx::protect_from_gc(test_values.values[i]);
+  }
+  jlcxx::gc_roots_checkpoint();
+  if(jlcxx::gc_root_stats().nb_added_since_checkpoint != 0)
+  {
+    throw std::runtime_error("values protected before the checkpoint are reported as new");
+  }
+
+  // Protecting an old value again doesn't make it new
+  jlcxx::protect_from_gc(test_values.values[0]);
+  const std::size_t nb_new = 5000;
+  for(std::size_t i = nb_old; i != nb_old + nb_new; ++i)
+  {
+    jlcxx::protect_from_gc(test_values.values[i]);
+  }
+  // Unprotecting half of the old values moves entries around in the table. The first value stays, since it was protected twice.
+  for(std::size_t i = 0; i < nb_old; i += 2)
+  {
+    jlcxx::unprotect_from_gc(test_values.values[i]);
+  }
+
+  const std::set<jl_value_t*> new_values(test_values.values.begin() + nb_old, test_values.values.begin() + nb_old + nb_new);
+  for(const jlcxx::GCRootEntry& entry : jlcxx::gc_root_entries())
+  {
+    if(test_values.value_set.count(entry.value) != 0 && entry.added_since_checkpoint != (new_values.count(entry.value) != 0))
+    {
+      throw std::runtime_error("wrong checkpoint state of a protected value");
+    }
+  }
+  const jlcxx::GCRootStats stats = jlcxx::gc_root_stats();
+  if(stats.nb_added_since_checkpoint != nb_new || stats.nb_protected != nb_protected_before + nb_new + nb_old/2 + 1)
+  {
+    throw std::runtime_error("unexpected number of new values after the checkpoint");
+  }
+
+  jlcxx::unprotect_from_gc(test_values.values[0]);
+  for(std::size_t i = 1; i != nb_old + nb_new; ++i)
+  {
+    if(i >= nb_old || i % 2 == 1)
+    {
+      jlcxx::unprotect_from_gc(test_values.values[i]);
+    }
+  }
+  check_counts("unprotecting the values of the checkpoint test", test_values, counts_t(), nb_protected_before);
+}
+
+/// Rooting a value permanently a second time doesn't add it again
+void test_permanent_roots(TestValues& test_values)
+{
+  const std::size_t permanent_before = jlcxx::gc_root_stats().nb_permanent;
+  jlcxx::protect_from_gc_permanently(test_values.values[0]);
+  jlcxx::protect_from_gc_permanently(test_values.values[0]);
+  jlcxx::protect_from_gc_permanently(test_values.array.wrapped());
+  if(jlcxx::gc_root_stats().nb_permanent != permanent_before + 1)
+  {
+    throw std::runtime_error("a permanent root was added more than once");
+  }
+}
+
+}
+
+int main()
+{
+  jlcxx::cxxwrap_init();
+
+  TestValues test_values(10000);
+
+  const std::size_t nb_protected_before = jlcxx::gc_root_stats().nb_protected;
+  test_duplicates(test_values, nb_protected_before);
+  test_unprotect_unprotected(test_values, nb_protected_before);
+  test_grow_shrink(test_values, nb_protected_before);
+  test_random(test_values, nb_protected_before);
+  test_unprotect_from_other_thread(test_values, nb_protected_before);
+  test_unprotect_staged(test_values, nb_protected_before);
+  test_thread_exit(test_values, nb_protected_before);
+  test_concurrent_scans(test_values, nb_protected_before);
+  test_rooted(test_values);
+  test_slot_reuse();
+  test_root_scope(test_values);
+  test_checkpoint(test_values, nb_protected_before);
+  test_permanent_roots(test_values);
+
+  jl_atexit_hook(0);
+  return 0;
+}
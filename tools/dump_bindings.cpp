@@ -0,0 +1,275 @@
+// Generate a Julia source file with static ccall stubs for the functions of a wrapped module, so the
+// loader doesn't need to generate and evaluate the wrapper methods each time the module is loaded.
+//
+// Usage: jlcxx_dump_bindings <wrapper library> <output.jl> [module name] [registration function]
+//
+// The generated file replaces @wrapfunctions: the enclosing Julia module still registers the C++ module
+// and creates the types (@readmodule and @wraptypes), includes the generated file and calls
+// __cxxwrap_init_stubs() from its __init__, after @initcxx. The stubs are only valid for the build of the
+// wrapper library they were generated from, which __cxxwrap_init_stubs checks.
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "jlcxx/jlcxx.hpp"
+#include "jlcxx/metadata_cache.hpp"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <dlfcn.h>
+#endif
+
+namespace
+{
+
+using regfunc_t = void (*)(jlcxx::Module&);
+
+regfunc_t load_registration_function(const std::string& library_path, const std::string& function_name)
+{
+#ifdef _WIN32
+  HMODULE handle = LoadLibraryA(library_path.c_str());
+  if(handle == nullptr)
+  {
+    throw std::runtime_error("Could not load library " + library_path);
+  }
+  void* f = reinterpret_cast<void*>(GetProcAddress(handle, function_name.c_str()));
+#else
+  void* handle = dlopen(library_path.c_str(), RTLD_NOW | RTLD_GLOBAL);
+  if(handle == nullptr)
+  {
+    throw std::runtime_error("Could not load library " + library_path + ": " + dlerror());
+  }
+  void* f = dlsym(handle, function_name.c_str());
+#endif
+  if(f == nullptr)
+  {
+    throw std::runtime_error("Function " + function_name + " not found in " + library_path);
+  }
+  return reinterpret_cast<regfunc_t>(f);
+}
+
+void check_julia_exception(const std::string& context)
+{
+  if(jl_exception_occurred())
+  {
+    jl_call2(jl_get_function(jl_base_module, "showerror"), jl_stderr_obj(), jl_exception_occurred());
+    jl_printf(jl_stderr_stream(), "\n");
+    throw std::runtime_error("Julia error while " + context);
+  }
+}
+
+/// Writes the stubs, printing types as seen from the generated module
+class StubWriter
+{
+public:
+  StubWriter(jl_module_t* jlmod, std::ostream& out) : m_module(jlmod), m_out(out)
+  {
+    m_show_function = jl_eval_string("(x, m) -> sprint(show, x; context = :module => m)");
+    check_julia_exception("creating the type printer");
+    jlcxx::protect_from_gc_permanently(m_show_function);
+  }
+
+  std::string repr(jl_value_t* v)
+  {
+    if(v == nullptr)
+    {
+      return "Cvoid";
+    }
+    jl_value_t* result = jl_call2(m_show_function, v, (jl_value_t*)m_module);
+    check_julia_exception("printing a type");
+    return jlcxx::julia_string(result);
+  }
+
+  void write_header(const std::string& library_path, const std::string& build_id, const std::size_t nb_functions)
+  {
+    m_out << "# Generated by jlcxx_dump_bindings from " << library_path << ", do not edit.\n";
+    m_out << "# Include in place of @wrapfunctions and call __cxxwrap_init_stubs() in __init__, after @initcxx.\n\n";
+    m_out << "const __cxxwrap_stub_build_id = \"" << build_id << "\"\n";
+    m_out << "const __cxxwrap_stub_pointers = Vector{Ptr{Cvoid}}(undef, " << nb_functions << ")\n";
+    m_out << "const __cxxwrap_stub_thunks = Vector{Ptr{Cvoid}}(undef, " << nb_functions << ")\n";
+    m_out << "const __cxxwrap_stub_has_thunk = Bool[";
+  }
+
+  /// The has_thunk array is written while the stubs are generated, so the loader can detect a mismatch
+  /// (e.g. when call statistics are enabled, all functions get a thunk)
+  void write_init(const std::vector<bool>& has_thunk)
+  {
+    for(std::size_t i = 0; i != has_thunk.size(); ++i)
+    {
+      m_out << (i == 0 ? "" : ", ") << (has_thunk[i] ? "true" : "false");
+    }
+    m_out << "]\n\n";
+    m_out << "function __cxxwrap_init_stubs()\n";
+    m_out << "  libcxxwrap_julia = CxxWrap.CxxWrapCore.libcxxwrap_julia\n";
+    m_out << "  build_id = ccall((:module_build_id, libcxxwrap_julia), Any, (Any,), @__MODULE__)\n";
+    m_out << "  build_id == __cxxwrap_stub_build_id || error(\"Stubs in \" * @__FILE__ * \" were generated for a different build of the wrapper library\")\n";
+    m_out << "  ccall((:get_module_function_pointers, libcxxwrap_julia), Cvoid, (Any, Any, Any), @__MODULE__, __cxxwrap_stub_pointers, __cxxwrap_stub_thunks)\n";
+    m_out << "  for i in eachindex(__cxxwrap_stub_thunks)\n";
+    m_out << "    (__cxxwrap_stub_thunks[i] != C_NULL) == __cxxwrap_stub_has_thunk[i] || error(\"Calling convention of function \", i, \" doesn't match the stubs\")\n";
+    m_out << "  end\n";
+    m_out << "end\n\n";
+  }
+
+  /// Returns true if the function takes a thunk
+  bool write_stub(jlcxx::FunctionWrapperBase& f, const std::size_t index)
+  {
+    const auto argument_types = f.argument_types();
+    const std::vector<jl_datatype_t*> ccall_types = f.ccall_argument_types();
+    const bool has_thunk = f.thunk() != nullptr;
+    const std::size_t nb_args = argument_types.size();
+
+    std::vector<std::string> argnames(nb_args);
+    for(std::size_t i = 0; i != nb_args; ++i)
+    {
+      argnames[i] = "arg" + std::to_string(i+1);
+    }
+    if(f.number_of_keyword_arguments() != 0 || !f.argument_default_values().empty())
+    {
+      m_out << "# Default and keyword arguments are not generated, all arguments are positional\n";
+    }
+
+    // Method signature, with the special function names used for constructors and call operators
+    std::size_t first_arg = 0;
+    jl_value_t* name = f.name();
+    m_out << "function ";
+    if(jl_is_symbol(name))
+    {
+      if(f.override_module() != (jl_value_t*)m_module)
+      {
+        m_out << repr(f.override_module()) << ".:(" << jlcxx::symbol_name((jl_sym_t*)name) << ")";
+      }
+      else
+      {
+        m_out << "var\"" << jlcxx::symbol_name((jl_sym_t*)name) << "\"";
+      }
+    }
+    else
+    {
+      const std::string nametype = jl_symbol_name(((jl_datatype_t*)jl_typeof(name))->name->name);
+      if(nametype == "ConstructorFname")
+      {
+        m_out << "(::Type{" << repr(jl_get_nth_field(name, 0)) << "})";
+      }
+      else if(nametype == "CallOpOverload" && nb_args != 0)
+      {
+        m_out << "(" << argnames[0] << "::" << repr((jl_value_t*)argument_types[0]) << ")";
+        first_arg = 1;
+      }
+      else
+      {
+        throw std::runtime_error("Unsupported function name type " + nametype);
+      }
+    }
+    m_out << "(";
+    for(std::size_t i = first_arg; i != nb_args; ++i)
+    {
+      m_out << (i == first_arg ? "" : ", ") << argnames[i] << "::" << repr((jl_value_t*)argument_types[i]);
+    }
+    m_out << ")\n";
+
+    // Body: a single ccall through the pointer tables filled in by __cxxwrap_init_stubs
+    const std::string julia_index = std::to_string(index+1);
+    m_out << "  ccall(__cxxwrap_stub_pointers[" << julia_index << "], " << repr((jl_value_t*)f.return_type().first) << ", (";
+    std::size_t nb_ccall_args = 0;
+    if(has_thunk)
+    {
+      m_out << "Ptr{Cvoid}";
+      ++nb_ccall_args;
+    }
+    for(jl_datatype_t* dt : ccall_types)
+    {
+      m_out << (nb_ccall_args == 0 ? "" : ", ") << repr((jl_value_t*)dt);
+      ++nb_ccall_args;
+    }
+    m_out << (nb_ccall_args == 1 ? ",)" : ")");
+    if(has_thunk)
+    {
+      m_out << ", __cxxwrap_stub_thunks[" << julia_index << "]";
+    }
+    for(std::size_t i = 0; i != nb_args; ++i)
+    {
+      m_out << ", " << argnames[i];
+      if(ccall_types[i] == jl_voidpointer_type && argument_types[i] != jl_voidpointer_type)
+      {
+        m_out << ".cpp_object";
+      }
+    }
+    m_out << ")";
+    if(f.return_type().second != nullptr && f.return_type().second != f.return_type().first)
+    {
+      m_out << "::" << repr((jl_value_t*)f.return_type().second);
+    }
+    m_out << "\nend\n\n";
+
+    return has_thunk;
+  }
+
+private:
+  jl_module_t* m_module;
+  std::ostream& m_out;
+  jl_value_t* m_show_function;
+};
+
+void dump_bindings(const std::string& library_path, const std::string& output_path, const std::string& module_name, const std::string& function_name)
+{
+  regfunc_t regfunc = load_registration_function(library_path, function_name);
+
+  // Same setup as @wrapmodule, but functions are written out instead of evaluated
+  const std::string module_definition = "module " + module_name + "\n using CxxWrap\n const __cxxwrap_pointers = Ptr{Cvoid}[]\nend";
+  jl_module_t* jlmod = (jl_module_t*)jl_eval_string(module_definition.c_str());
+  check_julia_exception("creating module " + module_name);
+  register_julia_module(jlmod, regfunc);
+  check_julia_exception("registering module " + module_name);
+  jl_call1(jl_get_function(jlcxx::get_cxxwrap_module(), "wraptypes"), (jl_value_t*)jlmod);
+  check_julia_exception("creating the types of module " + module_name);
+
+  // The stubs are generated first, since the header needs the function count and calling conventions
+  jlcxx::Module& mod = jlcxx::registry().get_module(jlmod);
+  std::stringstream stubs;
+  StubWriter stub_writer(jlmod, stubs);
+  std::vector<bool> has_thunk;
+  mod.for_each_function([&] (jlcxx::FunctionWrapperBase& f)
+  {
+    has_thunk.push_back(stub_writer.write_stub(f, has_thunk.size()));
+  });
+
+  std::ofstream out(output_path, std::ios::trunc);
+  StubWriter writer(jlmod, out);
+  writer.write_header(library_path, jlcxx::library_build_id(mod.library_address()), has_thunk.size());
+  writer.write_init(has_thunk);
+  out << stubs.str();
+
+  if(!out)
+  {
+    throw std::runtime_error("Failed to write " + output_path);
+  }
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  if(argc < 3 || argc > 5)
+  {
+    std::cerr << "Usage: " << argv[0] << " <wrapper library> <output.jl> [module name] [registration function]" << std::endl;
+    return 1;
+  }
+
+  try
+  {
+    jlcxx::set_call_statistics_enabled(false);
+    jlcxx::cxxwrap_init();
+    dump_bindings(argv[1], argv[2], argc > 3 ? argv[3] : "CxxWrapBindings", argc > 4 ? argv[4] : "define_julia_module");
+  }
+  catch(const std::exception& e)
+  {
+    std::cerr << "Error generating bindings: " << e.what() << std::endl;
+    jl_atexit_hook(1);
+    return 1;
+  }
+
+  jl_atexit_hook(0);
+  return 0;
+}